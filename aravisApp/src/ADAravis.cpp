@@ -9,16 +9,26 @@
  */
 
 /* System includes */
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <map>
+#include <memory>
 #include <math.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
 
 /* EPICS includes */
 #include <iocsh.h>
 #include <alarm.h>
 #include <epicsExit.h>
+#include <epicsMutex.h>
 #include <epicsEndian.h>
+#include <epicsStdio.h>
 #include <epicsString.h>
 #include <epicsThread.h>
 #include <initHooks.h>
@@ -32,14 +42,28 @@ extern "C" {
 }
 
 #include <epicsExport.h>
+#include <arvArrayPool.h>
+#include <arvDiscovery.h>
 #include <arvFeature.h>
+#include <arvRecorder.h>
+#include <arvShmRing.h>
 
 #define DRIVER_VERSION "2.3"
 // aravis does not define the Mono12p format yet.
 #define ARV_PIXEL_FORMAT_MONO_12_P         ((ArvPixelFormat) 0x010c0047u)
 
-/* number of raw buffers in our queue */
+/* default number of raw buffers in our queue */
 #define NRAW 20
+/* maximum number of raw buffers per stream, this sets the size of the message queue */
+#define MAX_NRAW 500
+/* number of bins in the software trigger latency histogram, the last one counts everything above it */
+#define TRIGGER_HIST_SIZE 100
+/* a software trigger with no frame after this many seconds is counted as missed */
+#define TRIGGER_TIMEOUT 1.0
+
+/* aravis version for conditional compilation */
+#define ARAVIS_VERSION_INT(major, minor, micro) (((major) << 16) | ((minor) << 8) | (micro))
+#define ARAVIS_VERSION_CURRENT ARAVIS_VERSION_INT(ARAVIS_MAJOR_VERSION, ARAVIS_MINOR_VERSION, ARAVIS_MICRO_VERSION)
 
 /* driver name for asyn trace prints */
 static const char *driverName = "ADAravis";
@@ -47,6 +71,15 @@ static const char *driverName = "ADAravis";
 /* flag to say IOC is running */
 static int iocRunning = 0;
 
+class ADAravis;
+/* Seconds iocInit waits for the cameras that connect in parallel, 0 to connect each camera in aravisConfig */
+static double parallelInitTimeout = 0;
+/* The cameras connecting in parallel, and the lock for the list */
+static std::vector<ADAravis*> parallelInitCameras;
+static epicsMutexId parallelInitLock = NULL;
+/* Set by aravisBulkRestore for the cameras configured after it to collect the writes done while the IOC starts */
+static int bulkRestore = 0;
+
 /* lookup for binning mode strings */
 struct bin_lookup {
     const char * mode;
@@ -65,9 +98,17 @@ static const struct bin_lookup bin_lookup[] = {
 };
 
 /* lookup for pixel format types */
+/* How a pixel format is unpacked into 16 bit pixels */
+typedef enum {
+    AravisUnpackNone,
+    AravisUnpackMono12p,
+    AravisUnpackMono12Packed
+} AravisUnpack_t;
+
 struct pix_lookup {
     ArvPixelFormat fmt;
     int colorMode, dataType, bayerFormat;
+    int unpack;
 };
 
 typedef enum {
@@ -81,26 +122,343 @@ typedef enum {
     AravisShiftRight
 } AravisShift_t;
 
+/* Mapping of 16 bit data to 8 bit output */
+typedef enum {
+    AravisLUTOff,
+    AravisLUTLinear,
+    AravisLUTGamma,
+    AravisLUTLog
+} AravisLUT_t;
+
+typedef enum {
+    AravisUSBModeDefault,
+    AravisUSBModeSync,
+    AravisUSBModeAsync
+} AravisUSBMode_t;
+
+typedef enum {
+    AravisOverflowDropNewest,
+    AravisOverflowDropOldest,
+    AravisOverflowBlock
+} AravisOverflowPolicy_t;
+
+typedef enum {
+    AravisPktSocketAuto,
+    AravisPktSocketDisabled
+} AravisPktSocket_t;
+
+typedef enum {
+    AravisArenaOff,
+    AravisArenaPinned,
+    AravisArenaHugePages
+} AravisArena_t;
+
+typedef enum {
+    AravisShmOff,
+    AravisShmRaw,
+    AravisShmConverted
+} AravisShm_t;
+
+/* How fast a raw capture is replayed */
+typedef enum {
+    AravisReplayOriginal,
+    AravisReplayMax
+} AravisReplayMode_t;
+
+typedef enum {
+    AravisSWBinSum,
+    AravisSWBinMean
+} AravisSWBinMode_t;
+
+/* software crop, binning and decimation applied while unpacking mono frames */
+struct sw_reduce {
+    int minX, minY, sizeX, sizeY;
+    int bin, mode, decimate;
+};
+
+/* Pixels unpacked, shifted and measured at a time, so the statistics read data that is still in the cache */
+#define CONVERT_BLOCK 8192
+#define MAX_HIST_SIZE 256
+
+/* Statistics taken while converting a frame, instead of in a separate pass by NDPluginStats */
+struct frame_stats {
+    /* settings */
+    bool enabled;
+    epicsUInt32 fullScale;
+    int histSize;
+    /* result */
+    epicsUInt32 min, max;
+    epicsUInt64 sum, saturated, count;
+    epicsUInt32 hist[MAX_HIST_SIZE];
+    /* bin = value * histScale >> 32 */
+    epicsUInt64 histScale;
+};
+
+/** Reset the statistics for a frame of dataType. A fullScale of 0 is the maximum of the data type */
+static void startStats(struct frame_stats *stats, int dataType) {
+    epicsUInt32 typeMax = (dataType == NDUInt8) ? 0xff : (dataType == NDUInt16) ? 0xffff : 0xffffffff;
+    if ((stats->fullScale == 0) || (stats->fullScale > typeMax)) stats->fullScale = typeMax;
+    if (stats->histSize > MAX_HIST_SIZE) stats->histSize = MAX_HIST_SIZE;
+    stats->histScale = ((epicsUInt64) stats->histSize << 32) / ((epicsUInt64) stats->fullScale + 1);
+    stats->min = typeMax;
+    stats->max = 0;
+    stats->sum = 0;
+    stats->saturated = 0;
+    stats->count = 0;
+    memset(stats->hist, 0, sizeof(stats->hist));
+}
+
+/** Add n values to the statistics. The loops are kept simple so the compiler vectorizes them */
+template <typename epicsType>
+static void accumulateStats(const epicsType *pData, size_t n, struct frame_stats *stats) {
+    epicsType lo = (epicsType) stats->min, hi = (epicsType) stats->max;
+    const epicsType full = (epicsType) stats->fullScale;
+    epicsUInt64 sum = 0, saturated = 0;
+
+    for (size_t i = 0; i < n; i++) {
+        epicsType v = pData[i];
+        lo = (v < lo) ? v : lo;
+        hi = (v > hi) ? v : hi;
+        sum += v;
+        saturated += (v >= full);
+    }
+    stats->min = lo;
+    stats->max = hi;
+    stats->sum += sum;
+    stats->saturated += saturated;
+    stats->count += n;
+    if (stats->histSize > 0) {
+        /* Four histograms, so consecutive pixels in the same bin do not wait for each other */
+        const epicsUInt64 scale = stats->histScale;
+        epicsUInt32 hist[4][MAX_HIST_SIZE];
+        memset(hist, 0, sizeof(epicsUInt32) * 4 * MAX_HIST_SIZE);
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            for (int j = 0; j < 4; j++) {
+                epicsUInt64 v = (pData[i+j] < full) ? pData[i+j] : full;
+                hist[j][(v * scale) >> 32]++;
+            }
+        }
+        for (; i < n; i++) {
+            epicsUInt64 v = (pData[i] < full) ? pData[i] : full;
+            hist[0][(v * scale) >> 32]++;
+        }
+        for (int b = 0; b < stats->histSize; b++) {
+            stats->hist[b] += hist[0][b] + hist[1][b] + hist[2][b] + hist[3][b];
+        }
+    }
+}
+
+/* The settings a converter needs that are not template parameters */
+struct convert_args {
+    int shiftBits;
+    /* The linear window: out = (in - lutOffset) * lutScale */
+    float lutOffset;
+    float lutScale;
+    /* 65536 entries, for the other LUT modes */
+    const epicsUInt8 *lut;
+};
+
+/* Converts pixels first to first+n-1 of a frame. 16 bit output is converted in place in pData, or unpacked from
+ * the packed data in pIn. 8 bit output is written to pData from the packed or 16 bit data in pIn */
+typedef void (*convert_func)(const void *pIn, void *pData, size_t first, int n, const struct convert_args *args,
+                             struct frame_stats *stats);
+
+/** Unpack n pixels from pPacked into block, or shift block in place if the data is not packed */
+template <int unpack, bool high, int shiftDir, typename epicsType>
+static inline void unpackBlock(const epicsUInt8 *pPacked, epicsType *block, int n, int shiftBits) {
+    if (unpack != AravisUnpackNone) {
+        /* Two 12 bit pixels in 3 bytes. A block starts on an even pixel */
+        const epicsUInt8 *pIn = pPacked;
+        const int up = high ? 4 : 0;
+        int i = 0;
+        for (; i + 1 < n; i += 2, pIn += 3) {
+            if (unpack == AravisUnpackMono12p) {
+                block[i] = (epicsType) ((pIn[0] | ((pIn[1] & 0x0F) << 8)) << up);
+            } else {
+                block[i] = (epicsType) (((pIn[0] << 4) | (pIn[1] & 0x0F)) << up);
+            }
+            block[i+1] = (epicsType) (((pIn[2] << 4) | (pIn[1] >> 4)) << up);
+        }
+        if (i < n) {
+            if (unpack == AravisUnpackMono12p) {
+                block[i] = (epicsType) ((pIn[0] | ((pIn[1] & 0x0F) << 8)) << up);
+            } else {
+                block[i] = (epicsType) (((pIn[0] << 4) | (pIn[1] & 0x0F)) << up);
+            }
+        }
+    }
+    if (shiftDir == AravisShiftLeft) {
+        for (int i = 0; i < n; i++) block[i] = block[i] << shiftBits;
+    } else if (shiftDir == AravisShiftRight) {
+        for (int i = 0; i < n; i++) block[i] = block[i] >> shiftBits;
+    }
+}
+
+/** Unpack, shift and take the statistics of a block of pixels. Everything that depends on the pixel format
+  * and the settings is a template parameter, so each combination is compiled without any branches on them */
+template <int unpack, bool high, int shiftDir, typename epicsType, bool withStats>
+static void convertBlock(const void *pIn, void *pData, size_t first, int n, const struct convert_args *args,
+                         struct frame_stats *stats) {
+    epicsType *block = (epicsType *) pData + first;
+
+    const epicsUInt8 *pPacked = (unpack != AravisUnpackNone) ? (const epicsUInt8 *) pIn + first / 2 * 3 : NULL;
+
+    unpackBlock<unpack, high, shiftDir>(pPacked, block, n, args->shiftBits);
+    if (withStats) accumulateStats(block, n, stats);
+}
+
+/** The same as convertBlock, then map the 16 bit pixels to 8 bits. The linear window is done with arithmetic
+  * the compiler vectorizes, the other modes look the pixels up in a 64 kB table */
+template <int unpack, bool high, int shiftDir, bool linear, bool withStats>
+static void convertBlockLUT(const void *pIn, void *pData, size_t first, int n, const struct convert_args *args,
+                            struct frame_stats *stats) {
+    epicsUInt16 line[CONVERT_BLOCK];
+    const epicsUInt16 *block = line;
+    epicsUInt8 *pOut = (epicsUInt8 *) pData + first;
+
+    if (unpack != AravisUnpackNone) {
+        unpackBlock<unpack, high, shiftDir>((const epicsUInt8 *) pIn + first / 2 * 3, line, n, args->shiftBits);
+    } else if (shiftDir != AravisShiftNone) {
+        memcpy(line, (const epicsUInt16 *) pIn + first, n * sizeof(epicsUInt16));
+        unpackBlock<unpack, high, shiftDir>(NULL, line, n, args->shiftBits);
+    } else {
+        block = (const epicsUInt16 *) pIn + first;
+    }
+    if (linear) {
+        const float offset = args->lutOffset, scale = args->lutScale;
+        for (int i = 0; i < n; i++) {
+            float v = (block[i] - offset) * scale + 0.5f;
+            pOut[i] = (epicsUInt8) std::min(std::max(v, 0.f), 255.f);
+        }
+    } else {
+        const epicsUInt8 *lut = args->lut;
+        for (int i = 0; i < n; i++) pOut[i] = lut[block[i]];
+    }
+    if (withStats) accumulateStats(pOut, n, stats);
+}
+
+#define CONVERT_STATS(unpack, high, shift) \
+    { convertBlock<unpack, high, shift, epicsUInt16, false>, convertBlock<unpack, high, shift, epicsUInt16, true> }
+#define CONVERT_SHIFT(unpack, high) \
+    { CONVERT_STATS(unpack, high, AravisShiftNone), CONVERT_STATS(unpack, high, AravisShiftLeft), \
+      CONVERT_STATS(unpack, high, AravisShiftRight) }
+#define CONVERT_HIGH(unpack) \
+    { CONVERT_SHIFT(unpack, false), CONVERT_SHIFT(unpack, true) }
+
+/* The 16 bit converters, indexed by AravisUnpack_t, Mono16High, AravisShift_t and statistics */
+static const convert_func convert16[3][2][3][2] = {
+    CONVERT_HIGH(AravisUnpackNone),
+    CONVERT_HIGH(AravisUnpackMono12p),
+    CONVERT_HIGH(AravisUnpackMono12Packed)
+};
+
+#define CONVERT_LUT_STATS(unpack, high, shift, linear) \
+    { convertBlockLUT<unpack, high, shift, linear, false>, convertBlockLUT<unpack, high, shift, linear, true> }
+#define CONVERT_LUT_LINEAR(unpack, high, shift) \
+    { CONVERT_LUT_STATS(unpack, high, shift, true), CONVERT_LUT_STATS(unpack, high, shift, false) }
+#define CONVERT_LUT_SHIFT(unpack, high) \
+    { CONVERT_LUT_LINEAR(unpack, high, AravisShiftNone), CONVERT_LUT_LINEAR(unpack, high, AravisShiftLeft), \
+      CONVERT_LUT_LINEAR(unpack, high, AravisShiftRight) }
+#define CONVERT_LUT_HIGH(unpack) \
+    { CONVERT_LUT_SHIFT(unpack, false), CONVERT_LUT_SHIFT(unpack, true) }
+
+/* The 16 to 8 bit converters, indexed by AravisUnpack_t, Mono16High, AravisShift_t, table and statistics */
+static const convert_func convertLUT[3][2][3][2][2] = {
+    CONVERT_LUT_HIGH(AravisUnpackNone),
+    CONVERT_LUT_HIGH(AravisUnpackMono12p),
+    CONVERT_LUT_HIGH(AravisUnpackMono12Packed)
+};
+
+/** The converter for frames of dataType, or NULL if there is nothing to do.
+    Only 16 bit data is unpacked, shifted and mapped to 8 bits with lutMode */
+static convert_func selectConverter(int unpack, bool high, int shiftDir, int dataType, bool stats, int lutMode) {
+    switch (dataType) {
+        case NDUInt16:
+            if (lutMode != AravisLUTOff) {
+                return convertLUT[unpack][high ? 1 : 0][shiftDir][lutMode == AravisLUTLinear ? 0 : 1][stats ? 1 : 0];
+            }
+            if ((unpack == AravisUnpackNone) && (shiftDir == AravisShiftNone) && !stats) return NULL;
+            return convert16[unpack][high ? 1 : 0][shiftDir][stats ? 1 : 0];
+        case NDUInt32:
+            return stats ? convertBlock<AravisUnpackNone, false, AravisShiftNone, epicsUInt32, true> : NULL;
+        default:
+            return stats ? convertBlock<AravisUnpackNone, false, AravisShiftNone, epicsUInt8, true> : NULL;
+    }
+}
+
+/* The SFNC device events that are published. The camera gives the event ID in the Event<name> feature,
+ * and the event data in the Event<name>... features, e.g. EventExposureEndTimestamp */
+#define NUM_EVENTS 4
+struct event_lookup {
+    const char *name;
+    const char *param;
+};
+
+static const struct event_lookup event_lookup[NUM_EVENTS] = {
+    { "ExposureStart",      "EXPOSURE_START"       },
+    { "ExposureEnd",        "EXPOSURE_END"         },
+    { "FrameStart",         "FRAME_START"          },
+    { "FrameTriggerMissed", "FRAME_TRIGGER_MISSED" }
+};
+
+/* A GenICam feature write waiting for the write thread. Only the last value for each feature is kept */
+struct feature_write {
+    bool isDouble;
+    epicsInt32 intValue;
+    double doubleValue;
+    epicsTimeStamp queued;
+};
+
+/* Features that other features depend on, in the order a bulk apply writes them.
+ * Everything else is written after these. OffsetX and OffsetY are set to 0 before Width and Height
+ * so that any size fits, and to their new values afterwards */
+static const char *bulk_order[] = {
+    "PixelFormat",
+    "BinningSelector", "BinningHorizontalMode", "BinningVerticalMode", "BinningHorizontal", "BinningVertical",
+    "DecimationHorizontal", "DecimationVertical",
+    "Width", "Height", "OffsetX", "OffsetY",
+    "AcquisitionMode",
+    "TriggerSelector", "TriggerMode", "TriggerSource", "TriggerActivation",
+    "ExposureMode", "ExposureAuto", "ExposureTime",
+    "GainSelector", "GainAuto", "Gain",
+    "BlackLevelSelector", "BlackLevel",
+    "AcquisitionFrameRateEnable", "AcquisitionFrameRate"
+};
+
+/* A frame held in the pre-trigger ring, still packed as it came from the camera */
+struct ring_frame {
+    ArvBuffer *buffer;
+    int payload;
+    epicsTimeStamp time;
+};
+
+/* An event as queued by the aravis callback */
+struct device_event {
+    int index;
+    epicsTimeStamp time;
+};
+
 static const struct pix_lookup pix_lookup[] = {
-    { ARV_PIXEL_FORMAT_MONO_8,        NDColorModeMono,  NDUInt8,  0           },
-    { ARV_PIXEL_FORMAT_RGB_8_PACKED,  NDColorModeRGB1,  NDUInt8,  0           },
-    { ARV_PIXEL_FORMAT_BAYER_GR_8,    NDColorModeBayer, NDUInt8,  NDBayerGRBG },
-    { ARV_PIXEL_FORMAT_BAYER_RG_8,    NDColorModeBayer, NDUInt8,  NDBayerRGGB },
-    { ARV_PIXEL_FORMAT_BAYER_GB_8,    NDColorModeBayer, NDUInt8,  NDBayerGBRG },
-    { ARV_PIXEL_FORMAT_BAYER_BG_8,    NDColorModeBayer, NDUInt8,  NDBayerBGGR },
+    { ARV_PIXEL_FORMAT_MONO_8,        NDColorModeMono,  NDUInt8,  0,           AravisUnpackNone },
+    { ARV_PIXEL_FORMAT_RGB_8_PACKED,  NDColorModeRGB1,  NDUInt8,  0,           AravisUnpackNone },
+    { ARV_PIXEL_FORMAT_BAYER_GR_8,    NDColorModeBayer, NDUInt8,  NDBayerGRBG, AravisUnpackNone },
+    { ARV_PIXEL_FORMAT_BAYER_RG_8,    NDColorModeBayer, NDUInt8,  NDBayerRGGB, AravisUnpackNone },
+    { ARV_PIXEL_FORMAT_BAYER_GB_8,    NDColorModeBayer, NDUInt8,  NDBayerGBRG, AravisUnpackNone },
+    { ARV_PIXEL_FORMAT_BAYER_BG_8,    NDColorModeBayer, NDUInt8,  NDBayerBGGR, AravisUnpackNone },
 // For Int16, use Mono16 if available, otherwise Mono12
-    { ARV_PIXEL_FORMAT_MONO_16,       NDColorModeMono,  NDUInt16, 0           },
-    { ARV_PIXEL_FORMAT_MONO_14,       NDColorModeMono,  NDUInt16, 0           },
-    { ARV_PIXEL_FORMAT_MONO_12,       NDColorModeMono,  NDUInt16, 0           },
-    { ARV_PIXEL_FORMAT_MONO_12_P,     NDColorModeMono,  NDUInt16, 0           },
-    { ARV_PIXEL_FORMAT_MONO_12_PACKED,NDColorModeMono,  NDUInt16, 0           },
-    { ARV_PIXEL_FORMAT_MONO_10,       NDColorModeMono,  NDUInt16, 0           },
-    { ARV_PIXEL_FORMAT_RGB_12_PACKED, NDColorModeRGB1,  NDUInt16, 0           },
-    { ARV_PIXEL_FORMAT_RGB_10_PACKED, NDColorModeRGB1,  NDUInt16, 0           },
-    { ARV_PIXEL_FORMAT_BAYER_GR_12,   NDColorModeBayer, NDUInt16, NDBayerGRBG },
-    { ARV_PIXEL_FORMAT_BAYER_RG_12,   NDColorModeBayer, NDUInt16, NDBayerRGGB },
-    { ARV_PIXEL_FORMAT_BAYER_GB_12,   NDColorModeBayer, NDUInt16, NDBayerGBRG },
-    { ARV_PIXEL_FORMAT_BAYER_BG_12,   NDColorModeBayer, NDUInt16, NDBayerBGGR }
+    { ARV_PIXEL_FORMAT_MONO_16,       NDColorModeMono,  NDUInt16, 0,           AravisUnpackNone },
+    { ARV_PIXEL_FORMAT_MONO_14,       NDColorModeMono,  NDUInt16, 0,           AravisUnpackNone },
+    { ARV_PIXEL_FORMAT_MONO_12,       NDColorModeMono,  NDUInt16, 0,           AravisUnpackNone },
+    { ARV_PIXEL_FORMAT_MONO_12_P,     NDColorModeMono,  NDUInt16, 0,           AravisUnpackMono12p },
+    { ARV_PIXEL_FORMAT_MONO_12_PACKED,NDColorModeMono,  NDUInt16, 0,           AravisUnpackMono12Packed },
+    { ARV_PIXEL_FORMAT_MONO_10,       NDColorModeMono,  NDUInt16, 0,           AravisUnpackNone },
+    { ARV_PIXEL_FORMAT_RGB_12_PACKED, NDColorModeRGB1,  NDUInt16, 0,           AravisUnpackNone },
+    { ARV_PIXEL_FORMAT_RGB_10_PACKED, NDColorModeRGB1,  NDUInt16, 0,           AravisUnpackNone },
+    { ARV_PIXEL_FORMAT_BAYER_GR_12,   NDColorModeBayer, NDUInt16, NDBayerGRBG, AravisUnpackNone },
+    { ARV_PIXEL_FORMAT_BAYER_RG_12,   NDColorModeBayer, NDUInt16, NDBayerRGGB, AravisUnpackNone },
+    { ARV_PIXEL_FORMAT_BAYER_GB_12,   NDColorModeBayer, NDUInt16, NDBayerGBRG, AravisUnpackNone },
+    { ARV_PIXEL_FORMAT_BAYER_BG_12,   NDColorModeBayer, NDUInt16, NDBayerBGGR, AravisUnpackNone }
 };
 
 // Helper to ensure that GError is free'd
@@ -121,6 +479,35 @@ struct GErrorHelper {
     }
 };
 
+/** Check whether this process may open the packet sockets that aravis uses for its fast GigE receive path.
+  * This needs CAP_NET_RAW, without it aravis falls back to normal UDP sockets */
+static bool packetSocketAvailable()
+{
+    int fd = socket(AF_PACKET, SOCK_RAW, 0);
+    if (fd < 0) return false;
+    close(fd);
+    return true;
+}
+
+/** Return the CPU time used by thread tid of this process in seconds, 0 if it cannot be read */
+static double threadCpuTime(int tid)
+{
+    char fileName[64], line[512];
+    unsigned long utime, stime;
+    const char *p;
+    FILE *fp;
+
+    epicsSnprintf(fileName, sizeof(fileName), "/proc/self/task/%d/stat", tid);
+    fp = fopen(fileName, "r");
+    if (!fp) return 0;
+    p = fgets(line, sizeof(line), fp);
+    fclose(fp);
+    /* The thread name is in parentheses and can contain spaces, the fields after it start with the state */
+    if (p) p = strrchr(line, ')');
+    if (!p || (sscanf(p + 1, " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &utime, &stime) != 2)) return 0;
+    return (double)(utime + stime) / sysconf(_SC_CLK_TCK);
+}
+
 /* Convert ArvBufferStatus enum to string */
 const char * ArvBufferStatusToString( ArvBufferStatus buffer_status )
 {
@@ -141,15 +528,119 @@ const char * ArvBufferStatusToString( ArvBufferStatus buffer_status )
     return pString;
 }
 
+/* The descriptor of the pixel format of the last frame of a stream and the converter for the settings it was
+ * converted with. These only change between acquisitions, so usually a frame just compares them */
+struct frame_converter {
+    int pixelFormat;
+    int shiftDir;
+    bool leftShift;
+    bool stats;
+    int lutMode;
+    const struct pix_lookup *pFormat;
+    convert_func convert;
+};
+
+/** One stream channel of the camera, with its own buffer pool, frame queue and scratch buffers.
+  * Frames from stream N are delivered on NDArray address N. Stream 0 is processed by the
+  * ADAravis polling thread, the others by their own thread so a slow stream does not stall the rest. */
+class aravisStream : public epicsThreadRunable {
+public:
+    aravisStream(ADAravis *pPvt, int index, int stackSize);
+    void run();
+
+    ADAravis *pPvt;
+    int index;
+    ArvStream *stream;
+    epicsMessageQueueId msgQId;
+    int payload;
+    int arrayCounter;
+    int nConsecutiveBadFrames;
+    int nBadFramesPrior;
+    /* Incremented each time the stream is made again. Each buffer carries the one it was made for */
+    std::atomic<int> generation;
+    /* Thread id of the aravis thread that receives the stream, 0 until the first frame */
+    std::atomic<int> receiveTid;
+    /* Written by the aravis stream thread */
+    std::atomic<int> droppedNewest;
+    std::atomic<int> droppedOldest;
+    /* Frames kept in the queue beyond ARAVIS_QUEUE_SIZE by the Block policy */
+    std::atomic<int> blocked;
+    std::atomic<int> highWater;
+    /* Buffers that could not be made because the NDArray pool was full */
+    std::atomic<int> allocFailures;
+    /* Buffers the stream is short of, made as soon as the pool has space again. Lock taken to access */
+    int deficit;
+    /* Frames given straight back to the stream to keep its reserve of buffers */
+    int reserveDrops;
+    /* Set when a frame did not fit in the buffers, so the payload has changed */
+    std::atomic<bool> sizeMismatch;
+    epicsThread *thread;
+    /* Taken to use the converter and the line buffers, which the replay thread shares with the stream thread */
+    epicsMutex convertLock;
+    std::vector<epicsUInt16> lineBuffer;
+    std::vector<epicsUInt32> binAccumulator;
+    struct frame_converter converter;
+};
+
+/* Everything needed to convert one frame. The settings are read from the parameter library
+ * with the lock taken so that the conversion itself can run without it */
+struct frame_info {
+    /* settings */
+    int shiftDir, shiftBits;
+    bool leftShift, reduceEnabled;
+    struct sw_reduce reduce;
+    int lutMode;
+    struct convert_args args;
+    /* Held so the table is not freed if the LUT settings change during the conversion */
+    std::shared_ptr<const std::vector<epicsUInt8> > lut;
+    /* result */
+    NDArray *pArray;
+    bool releaseArray;
+    int colorMode, dataType, bayerFormat;
+    int width, height, xOffset, yOffset, binX, binY;
+    size_t size;
+    struct frame_stats stats;
+};
+
+/* A frame as the camera sent it, from a stream buffer or from a raw capture being replayed */
+struct raw_frame {
+    NDArray *pRaw;              /* The NDArray holding the data */
+    struct arvRawEntry meta;    /* Size, geometry, pixel format, status, timestamps and frame ID */
+};
+
+/* Describe a stream buffer the way the recorder does */
+static void describeBuffer(ArvBuffer *buffer, int stream, struct raw_frame *pFrame) {
+    size_t size = 0;
+    struct arvRawEntry &meta = pFrame->meta;
+
+    pFrame->pRaw = (NDArray *) arv_buffer_get_user_data(buffer);
+    arv_buffer_get_data(buffer, &size);
+    memset(&meta, 0, sizeof(meta));
+    meta.size            = size;
+    meta.frameId         = arv_buffer_get_frame_id(buffer);
+    meta.timestamp       = arv_buffer_get_timestamp(buffer);
+    meta.systemTimestamp = arv_buffer_get_system_timestamp(buffer);
+    meta.pixelFormat     = arv_buffer_get_image_pixel_format(buffer);
+    meta.width           = arv_buffer_get_image_width(buffer);
+    meta.height          = arv_buffer_get_image_height(buffer);
+    meta.xOffset         = arv_buffer_get_image_x(buffer);
+    meta.yOffset         = arv_buffer_get_image_y(buffer);
+    meta.stream          = stream;
+    meta.status          = arv_buffer_get_status(buffer);
+}
+
 /** Aravis GigE detector driver */
 class ADAravis : public ADGenICam, epicsThreadRunable {
 public:
     /* Constructor */
     ADAravis(const char *portName, const char *cameraName, int enableCaching,
-                size_t maxMemory, int priority, int stackSize);
+                size_t maxMemory, int priority, int stackSize, int numStreams);
 
     /* These are the methods that we override from ADDriver */
     virtual asynStatus writeInt32(asynUser *pasynUser, epicsInt32 value);
+    virtual asynStatus writeFloat64(asynUser *pasynUser, epicsFloat64 value);
+    virtual asynStatus readInt32(asynUser *pasynUser, epicsInt32 *value);
+    virtual asynStatus readFloat64(asynUser *pasynUser, epicsFloat64 *value);
     virtual GenICamFeature *createFeature(GenICamFeatureSet *set, 
                                           std::string const & asynName, asynParamType asynType, int asynIndex,
                                           std::string const & featureName, GCFeatureType_t featureType);
@@ -160,16 +651,35 @@ public:
     /* This is the method we override from epicsThreadRunable */
     void run();
 
-    /* These should be private, but are used in the aravis callback so must be public */
-    epicsMessageQueueId msgQId;
-    void newBufferCallback(ArvStream *stream);
+    /* These should be private, but are used in the aravis callback and stream threads so must be public */
+    void newBufferCallback(aravisStream *pStream);
+    void streamTask(aravisStream *pStream);
+    void statusTask();
+    void eventTask();
+    void writeTask();
+    void connectTask();
+    void triggerTask();
+    void replayTask();
+    void deviceEventCallback(int eventId);
+    /* Copies of the overflow parameters, read by the aravis callback without the lock */
+    int overflowPolicy;
+    int queueSize;
+    /* Copies of the frame memory parameters, read by the stream threads without the lock */
+    int arenaMode;
+    int arenaNumaNode;
 
     /** Used by epicsAtExit */
     ArvCamera *camera;
+    arvRecorder recorder;
+    arvShmRing shmRing;
 
     /** Used by connection lost callback */
     int connectionValid;
 
+    /** Used to wait for the cameras that connect in parallel while the IOC starts */
+    epicsEventId connectEvent;
+    double connectTime;
+
 protected:
     int AravisCompleted;
     #define FIRST_ARAVIS_CAMERA_PARAM AravisCompleted
@@ -183,37 +693,283 @@ protected:
     int AravisConvertPixelFormat;
     int AravisShiftDir;
     int AravisShiftBits;
+    int AravisLUTMode;
+    int AravisLUTMin;
+    int AravisLUTMax;
+    int AravisLUTGamma;
+    int AravisSWBin;
+    int AravisSWBinMode;
+    int AravisSWDecimate;
+    int AravisSWMinX;
+    int AravisSWMinY;
+    int AravisSWSizeX;
+    int AravisSWSizeY;
+    int AravisNumStreams;
+    int AravisNumBuffers;
+    int AravisUSBMode;
+    int AravisUSBMaxTransfer;
+    int AravisTransferredBytes;
+    int AravisIgnoredBytes;
+    int AravisTransferRate;
+    int AravisPktSocket;
+    int AravisPktSocketActive;
+    int AravisSocketBufferSize;
+    int AravisCpuPerFrame;
+    int AravisOverflowPolicy;
+    int AravisQueueSize;
+    int AravisDroppedNewest;
+    int AravisDroppedOldest;
+    int AravisQueueBlocked;
+    int AravisQueueHighWater;
+    int AravisStreamInput;
+    int AravisStreamOutput;
+    int AravisQueuePending;
+    int AravisHeldDownstream;
+    int AravisAllocFailures;
+    int AravisBackPressure;
+    int AravisMinBuffers;
+    int AravisThrottle;
+    int AravisThrottled;
+    int AravisBufferDeficit;
+    int AravisReserveDrops;
+    int AravisStatusRate;
+    int AravisLiveDecimate;
+    int AravisLiveMaxRate;
+    int AravisLiveAddress;
+    int AravisAsyncWrites;
+    int AravisWriteLatency;
+    int AravisWritesDone;
+    int AravisWritesCoalesced;
+    int AravisRing;
+    int AravisRingMemory;
+    int AravisRingPostFrames;
+    int AravisRingTrigger;
+    int AravisRingFrames;
+    int AravisLiveReconfig;
+    int AravisReconfigTime;
+    int AravisReconfigCount;
+    int AravisArena;
+    int AravisArenaNumaNode;
+    int AravisArenaLocked;
+    int AravisRecord;
+    int AravisRecordOnly;
+    int AravisRecordBuffer;
+    int AravisRecordDirect;
+    int AravisRecordFrames;
+    int AravisRecordDropped;
+    int AravisRecordRate;
+    int AravisShm;
+    int AravisShmName;
+    int AravisShmSlots;
+    int AravisShmFrames;
+    int AravisShmSkipped;
+    int AravisStats;
+    int AravisStatsFullScale;
+    int AravisStatsHistSize;
+    int AravisStatsMin;
+    int AravisStatsMax;
+    int AravisStatsMean;
+    int AravisStatsSum;
+    int AravisStatsSaturated;
+    int AravisStatsHist;
+    int AravisBulkApply;
+    int AravisBulkApplyTime;
+    int AravisBulkWritten;
+    int AravisBulkSkipped;
+    int AravisEvents;
+    int AravisEventsActive;
+    int AravisConnectTime;
+    int AravisSoftTrigger;
+    int AravisTriggerCount;
+    int AravisTriggerMissed;
+    int AravisTriggerLatency;
+    int AravisTriggerLatencyMean;
+    int AravisTriggerLatencyMax;
+    int AravisTriggerHistBin;
+    int AravisTriggerHist;
+    int AravisTriggerReset;
+    int AravisReplay;
+    int AravisReplayFile;
+    int AravisReplayMode;
+    int AravisReplayLoop;
+    int AravisReplayFrames;
+    int AravisReplayRate;
+    int AravisReplayTime;
+    int AravisEventCount[NUM_EVENTS];
+    int AravisEventTime[NUM_EVENTS];
     int AravisConnection;
     int AravisReset;
     #define LAST_ARAVIS_CAMERA_PARAM AravisReset
 
 private:
-    asynStatus allocBuffer();
-    asynStatus processBuffer(ArvBuffer *buffer);
-    asynStatus lookupColorMode(ArvPixelFormat fmt, int *colorMode, int *dataType, int *bayerFormat);
+    asynStatus allocBuffer(aravisStream *pStream, bool retry = false);
+    void refillBuffers(aravisStream *pStream, int n);
+    bool holdReserve(aravisStream *pStream);
+    void updateThrottle();
+    double receiveCpuTime();
+    asynStatus processBuffer(aravisStream *pStream, const struct raw_frame *pFrame, const epicsTimeStamp *pTime = NULL);
+    int countFrame(aravisStream *pStream);
+    bool ringHold(aravisStream *pStream, ArvBuffer *buffer);
+    void ringFlush(aravisStream *pStream);
+    void ringClear();
+    bool publishLive();
+    void prepareArray(NDArray *pArray);
+    bool isImageFormatParam(int function);
+    bool liveReconfigActive();
+    asynStatus reconfigureLive(asynUser *pasynUser, epicsInt32 value, epicsFloat64 dvalue, bool isFloat);
+    asynStatus enableEvents(int enable);
+    asynStatus openRecording();
+    void closeRecording();
+    void updateRecordStatistics();
+    void openShm();
+    void publishShm(aravisStream *pStream, const struct raw_frame *pFrame, struct frame_info *info,
+                    const epicsTimeStamp *pTime);
+    bool queueFeatureWrite(int function, epicsInt32 intValue, double doubleValue, bool isDouble);
+    bool doFeatureWrite();
+    bool queueBulkWrite(int function, epicsInt32 intValue, double doubleValue, bool isDouble);
+    asynStatus applyBulkWrites();
+    void updateStatistics();
+    void triggerFrame(ArvBuffer *buffer);
+    void resetTriggerStatistics();
+    void updateTriggerStatistics();
+    void buildLUT();
+    asynStatus convertBuffer(aravisStream *pStream, const struct raw_frame *pFrame, struct frame_info *info);
+    const struct frame_converter *getConverter(aravisStream *pStream, int pixel_format, const struct frame_info *info);
+    bool getSoftwareReduce(struct sw_reduce *reduce);
+    NDArray *reduceMonoFrame(aravisStream *pStream, NDArray *pIn, size_t size, int pixel_format, int width, int height,
+                             bool leftShift, int shiftDir, int shiftBits, struct sw_reduce *reduce);
+    const epicsUInt16 *unpackMonoLine(aravisStream *pStream, const epicsUInt8 *pData, int pixel_format, int width,
+                                      int y, int x0, int n, bool leftShift, int shiftDir, int shiftBits);
     asynStatus lookupPixelFormat(int colorMode, int dataType, int bayerFormat, ArvPixelFormat *fmt);
     asynStatus connectToCamera();
     asynStatus makeCameraObject();
     asynStatus makeStreamObject();
+    ArvStream *createStream(int index, GError **err);
+    int getStreamPayload(int index);
+    const char *getStreamSelector();
 
-    ArvStream *stream;
+    std::vector<aravisStream*> streams;
     ArvDevice *device;
     ArvGc *genicam;
     char *cameraName;
     unsigned int featureIndex;
-    int payload;
     int mEnableCaching;
-    int nConsecutiveBadFrames;
-    int nBadFramesPrior;
+    double lastTransferredBytes;
+    epicsTimeStamp lastTransferTime;
+    double lastCpuTime;
+    double lastCpuFrames;
+    epicsTimeStamp lastCpuSample;
+    int liveCounter;
+    epicsTimeStamp lastLiveTime;
+    /* Pre-trigger ring of stream 0 frames, oldest first. Lock taken to access */
+    std::deque<struct ring_frame> ring;
+    double ringBytes;
+    int ringPostRemaining;
+    volatile bool ringFlushPending;
+    /* Histogram of the last stream 0 frame, published by updateStatistics. Lock taken to access */
+    std::vector<epicsInt32> statsHist;
+    bool statsHistNew;
+    /* The 16 to 8 bit mapping. A new table is made when the settings change. Lock taken to access */
+    std::shared_ptr<const std::vector<epicsUInt8> > lut;
+    float lutOffset;
+    float lutScale;
+    /* Set while the frame rate is reduced because the streams are short of buffers, and the rate before */
+    bool throttled;
+    double throttleRate;
+    /* Set while the recorder has a capture open. Lock taken to access */
+    bool recording;
+    double lastRecordBytes;
+    epicsTimeStamp lastRecordTime;
+    /* The NDArrayPool, which locks the frame memory for ARAVIS_ARENA */
+    arvArrayPool *arrayPool;
+    /* Feature writes waiting for the write thread, indexed by parameter. Lock taken to access */
+    std::map<int, struct feature_write> pendingWrites;
+    /* Feature writes collected for a bulk apply, indexed by parameter. Lock taken to access */
+    std::map<int, struct feature_write> bulkWrites;
+    epicsEventId writeEvent;
+    asynUser *pasynUserWrite;
+    /* Event IDs of the events in event_lookup, -1 if the camera does not have them */
+    int eventIds[NUM_EVENTS];
+    epicsMessageQueueId eventQId;
+    /* Wakes the status thread when the update rate changes, or when the buffers must be resized */
+    epicsEventId statusEvent;
+    /* Set by a stream thread when its frames no longer fit, the status thread resizes the buffers. Lock taken */
+    bool reconfigPending;
+    /* The TriggerSoftware command, looked up when connecting, and the lock to execute it */
+    epicsMutex triggerNodeLock;
+    ArvGcNode *triggerNode;
+    /* Software triggers requested and not yet sent by the trigger thread */
+    std::atomic<int> triggerRequests;
+    epicsEventId triggerEvent;
+    /* The time each software trigger was sent, until its frame arrives, and the latencies.
+       triggerLock taken to access, it is taken by the aravis callback */
+    epicsMutex triggerLock;
+    std::deque<gint64> triggerTimes;
+    int triggerCount;
+    int triggerMissed;
+    int triggerLatencies;
+    double triggerLatency;
+    double triggerLatencySum;
+    double triggerLatencyMax;
+    double triggerHistBin;
+    std::vector<epicsInt32> triggerHist;
+    bool triggerHistNew;
+    /* Set while the replay thread feeds a raw capture to processBuffer, cleared to stop it */
+    volatile bool replaying;
+    epicsEventId replayEvent;
     epicsThread pollingLoop;
     std::vector<arvFeature*> featureList;
 };
 
+aravisStream::aravisStream(ADAravis *pPvt, int index, int stackSize)
+    : pPvt(pPvt),
+      index(index),
+      stream(NULL),
+      payload(0),
+      arrayCounter(0),
+      nConsecutiveBadFrames(0),
+      nBadFramesPrior(0),
+      generation(0),
+      receiveTid(0),
+      droppedNewest(0),
+      droppedOldest(0),
+      blocked(0),
+      highWater(0),
+      allocFailures(0),
+      deficit(0),
+      reserveDrops(0),
+      sizeMismatch(false),
+      thread(NULL)
+{
+    char threadName[32];
+
+    this->converter.pixelFormat = -1;
+    this->converter.pFormat = NULL;
+    this->converter.convert = NULL;
+
+    /* Create a message queue to hold completed frames */
+    this->msgQId = epicsMessageQueueCreate(MAX_NRAW, sizeof(ArvBuffer*));
+    /* Stream 0 is processed by the ADAravis polling thread */
+    if (index > 0) {
+        epicsSnprintf(threadName, sizeof(threadName), "aravisStream%d", index);
+        this->thread = new epicsThread(*this, threadName,
+                                       stackSize>0 ? stackSize : epicsThreadGetStackSize(epicsThreadStackMedium),
+                                       epicsThreadPriorityHigh);
+    }
+}
+
+void aravisStream::run() {
+    pPvt->streamTask(this);
+}
+
 GenICamFeature *ADAravis::createFeature(GenICamFeatureSet *set, 
                                         std::string const & asynName, asynParamType asynType, int asynIndex,
                                         std::string const & featureName, GCFeatureType_t featureType) {
+    /* The camera may still be connecting in its own thread, which initializes the features made so far */
+    this->lock();
     arvFeature *pFeature = new arvFeature(set, asynName, asynType, asynIndex, featureName, featureType, this->device);
     featureList.push_back(pFeature);
+    this->unlock();
     return pFeature;
 }
 
@@ -225,6 +981,9 @@ static void aravisShutdown(void* arg) {
     printf("ADAravis: Stopping %s... ", pPvt->portName);
     arv_camera_stop_acquisition(cam, err.get());
     pPvt->connectionValid = 0;
+    /* Write out what the recorder still holds, and remove the shared memory */
+    pPvt->recorder.close();
+    pPvt->shmRing.close();
     epicsThreadSleep(0.1);
     pPvt->camera = NULL;
     g_object_unref(cam);
@@ -240,54 +999,184 @@ static void destroyBuffer(gpointer data){
     }
 }
 
+/* The generation of the stream a buffer was made for */
+#define GENERATION_KEY "ADAravisGeneration"
+
+/** True if the buffer was made for the current stream, so it has the current payload and can be given back
+    to it. Buffers of the stream that was there before are freed instead */
+static bool currentBuffer(aravisStream *pStream, ArvBuffer *buffer) {
+    return GPOINTER_TO_INT(g_object_get_data(G_OBJECT(buffer), GENERATION_KEY)) == pStream->generation;
+}
+
 /** Called by aravis when a new buffer is produced */
-static void newBufferCallbackC(ArvStream *stream, ADAravis *pPvt) {
-    pPvt->newBufferCallback(stream);
+static void newBufferCallbackC(ArvStream *stream, aravisStream *pStream) {
+    pStream->pPvt->newBufferCallback(pStream);
 }
 
-void ADAravis::newBufferCallback(ArvStream *stream) {
-    ArvBuffer *buffer;
+void ADAravis::newBufferCallback(aravisStream *pStream) {
+    ArvBuffer *buffer, *oldest;
+    ArvStream *stream = pStream->stream;
     int status;
+    int pending;
     static const char *functionName = "newBufferCallback";
 
+    /* This is the thread whose CPU time ARAVIS_CPU_PER_FRAME reports */
+    if (pStream->receiveTid == 0) pStream->receiveTid = (int) syscall(SYS_gettid);
     buffer = arv_stream_try_pop_buffer(stream);
     if (buffer == NULL)    return;
     ArvBufferStatus buffer_status = arv_buffer_get_status(buffer);
     if (buffer_status == ARV_BUFFER_STATUS_SUCCESS /*|| buffer->status == ARV_BUFFER_STATUS_MISSING_PACKETS*/) {
-        nConsecutiveBadFrames = 0;
-        status = epicsMessageQueueTrySend(this->msgQId,
-                &buffer,
-                sizeof(&buffer));
+        pStream->nConsecutiveBadFrames = 0;
+        /* The latency is measured here, so a full queue or slow plugins do not add to it */
+        if (pStream->index == 0) this->triggerFrame(buffer);
+        /* Apply the overflow policy if the queue is full */
+        if (epicsMessageQueuePending(pStream->msgQId) >= this->queueSize) {
+            switch (this->overflowPolicy) {
+                case AravisOverflowDropOldest:
+                    /* Give the oldest frame back to the stream so the queue always holds the latest frames */
+                    if (epicsMessageQueueTryReceive(pStream->msgQId, &oldest, sizeof(&oldest)) != -1) {
+                        if (currentBuffer(pStream, oldest)) arv_stream_push_buffer (stream, oldest);
+                        else g_object_unref(oldest);
+                        pStream->droppedOldest++;
+                    }
+                    break;
+                case AravisOverflowBlock:
+                    /* Keep the frame. This is the packet receive thread, so it must never wait: the stream
+                     * thread slows the camera down with ARAVIS_THROTTLE until the queue has drained */
+                    pStream->blocked++;
+                    break;
+                default:
+                    break;
+            }
+        }
+        status = (this->overflowPolicy != AravisOverflowBlock) &&
+                 (epicsMessageQueuePending(pStream->msgQId) >= this->queueSize);
+        if (!status) {
+            status = epicsMessageQueueTrySend(pStream->msgQId,
+                    &buffer,
+                    sizeof(&buffer));
+        }
         if (status) {
             asynPrint(pasynUserSelf, ASYN_TRACE_ERROR, 
-            "%s::%s message queue full, dropped buffer\n", driverName, functionName);
+            "%s::%s stream %d message queue full, dropped buffer\n", driverName, functionName, pStream->index);
             arv_stream_push_buffer (stream, buffer);
+            /* With Block the queue holds MAX_NRAW frames, and the frame has been counted as blocked */
+            if (this->overflowPolicy != AravisOverflowBlock) pStream->droppedNewest++;
+        } else {
+            pending = epicsMessageQueuePending(pStream->msgQId);
+            if (pending > pStream->highWater) pStream->highWater = pending;
         }
     } else {
         arv_stream_push_buffer (stream, buffer);
+        if (buffer_status == ARV_BUFFER_STATUS_SIZE_MISMATCH) pStream->sizeMismatch = true;
 
-        nConsecutiveBadFrames++;
-        if ( nConsecutiveBadFrames < 10 )
+        pStream->nConsecutiveBadFrames++;
+        if ( pStream->nConsecutiveBadFrames < 10 )
             asynPrint(pasynUserSelf, ASYN_TRACE_ERROR,
-                "%s::%s bad frame status: %s\n", 
-                driverName, functionName, ArvBufferStatusToString(buffer_status) );
-        else if ( ((nConsecutiveBadFrames-10) % 1000) == 0 ) {
+                "%s::%s stream %d bad frame status: %s\n", 
+                driverName, functionName, pStream->index, ArvBufferStatusToString(buffer_status) );
+        else if ( ((pStream->nConsecutiveBadFrames-10) % 1000) == 0 ) {
             asynPrint(pasynUserSelf, ASYN_TRACE_ERROR,
-                "%s::%s dad frame status: %s, %d msgs suppressed.\n", 
-                driverName, functionName, ArvBufferStatusToString(buffer_status), (nConsecutiveBadFrames - nBadFramesPrior));
-            nBadFramesPrior = nConsecutiveBadFrames;
+                "%s::%s stream %d bad frame status: %s, %d msgs suppressed.\n", 
+                driverName, functionName, pStream->index, ArvBufferStatusToString(buffer_status),
+                (pStream->nConsecutiveBadFrames - pStream->nBadFramesPrior));
+            pStream->nBadFramesPrior = pStream->nConsecutiveBadFrames;
         }
     }
 }
 
+/** Connect thread, connects to the camera while the other cameras of the IOC do the same */
+static void connectTaskC(void *drvPvt) {
+    ADAravis *pPvt = (ADAravis *) drvPvt;
+    pPvt->connectTask();
+}
+
+/** Trigger thread, sends the software triggers */
+static void triggerTaskC(void *drvPvt) {
+    ADAravis *pPvt = (ADAravis *) drvPvt;
+    pPvt->triggerTask();
+}
+
+/** Replay thread, feeds a raw capture to the frame processing */
+static void replayTaskC(void *drvPvt) {
+    ADAravis *pPvt = (ADAravis *) drvPvt;
+    pPvt->replayTask();
+}
+
+/** Status thread, publishes the statistics at ARAVIS_STATUS_RATE */
+static void statusTaskC(void *drvPvt) {
+    ADAravis *pPvt = (ADAravis *) drvPvt;
+    pPvt->statusTask();
+}
+
+/** Write thread, does the queued feature writes */
+static void writeTaskC(void *drvPvt) {
+    ADAravis *pPvt = (ADAravis *) drvPvt;
+    pPvt->writeTask();
+}
+
+/** Event thread, publishes the device events */
+static void eventTaskC(void *drvPvt) {
+    ADAravis *pPvt = (ADAravis *) drvPvt;
+    pPvt->eventTask();
+}
+
+static void deviceEventCallbackC(ArvDevice *device, int eventId, ADAravis *pPvt) {
+    pPvt->deviceEventCallback(eventId);
+}
+
+/** Called by aravis when the camera sends an event.
+    Does not take the lock, the event is queued for the event thread */
+void ADAravis::deviceEventCallback(int eventId) {
+    struct device_event event;
+
+    for (event.index=0; event.index<NUM_EVENTS; event.index++) {
+        if (this->eventIds[event.index] == eventId) break;
+    }
+    if (event.index == NUM_EVENTS) return;
+    epicsTimeGetCurrent(&event.time);
+    if (epicsMessageQueueTrySend(this->eventQId, &event, sizeof(event)) != 0) {
+        asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+            "%s:deviceEventCallback: event queue full, dropped %s event\n",
+            driverName, event_lookup[event.index].name);
+    }
+}
+
 /** Called by aravis when control signal is lost */
 static void controlLostCallback(ArvDevice *device, ADAravis *pPvt) {
     pPvt->connectionValid = 0;
 }
 
+/** Wait for the cameras that connect in parallel, so their features are there when the records are initialized.
+    A camera that is still connecting after the timeout holds up its own records until it has finished */
+static void waitForParallelInit() {
+    epicsTimeStamp start, now;
+
+    if (parallelInitLock == NULL) return;
+    epicsMutexMustLock(parallelInitLock);
+    std::vector<ADAravis*> cameras;
+    cameras.swap(parallelInitCameras);
+    epicsMutexUnlock(parallelInitLock);
+    if (cameras.empty()) return;
+    epicsTimeGetCurrent(&start);
+    for (auto pPvt : cameras) {
+        epicsTimeGetCurrent(&now);
+        double remaining = parallelInitTimeout - epicsTimeDiffInSeconds(&now, &start);
+        if (epicsEventWaitWithTimeout(pPvt->connectEvent, remaining > 0 ? remaining : 0) != epicsEventWaitOK) {
+            printf("ADAravis: %s is still connecting after %.1f s\n", pPvt->portName, parallelInitTimeout);
+        }
+    }
+    epicsTimeGetCurrent(&now);
+    printf("ADAravis: waited %.2f s for %d cameras to connect\n",
+           epicsTimeDiffInSeconds(&now, &start), (int)cameras.size());
+}
+
 /** Init hook that sets iocRunning flag */
 static void setIocRunningFlag(initHookState state) {
     switch(state) {
+        case initHookAtBeginning:
+            waitForParallelInit();
+            break;
         case initHookAfterIocRunning:
             iocRunning = 1;
             break;
@@ -307,20 +1196,38 @@ static void setIocRunningFlag(initHookState state) {
   *            allowed to allocate. Set this to -1 to allow an unlimited amount of memory.
   * \param[in] priority The thread priority for the asyn port driver thread if ASYN_CANBLOCK is set in asynFlags.
   * \param[in] stackSize The stack size for the asyn port driver thread if ASYN_CANBLOCK is set in asynFlags.
+  * \param[in] numStreams The number of stream channels to receive. Stream N is delivered on NDArray address N
+  *            if the port has that address. 0 means 1.
   */
 ADAravis::ADAravis(const char *portName, const char *cameraName, int enableCaching,
-                   size_t maxMemory, int priority, int stackSize)
+                   size_t maxMemory, int priority, int stackSize, int numStreams)
 
     : ADGenICam(portName, maxMemory, priority, stackSize),
+       overflowPolicy(AravisOverflowDropNewest),
+       queueSize(NRAW),
+       arenaMode(AravisArenaOff),
+       arenaNumaNode(-1),
        camera(NULL),
        connectionValid(0),
-       stream(NULL),
+       connectEvent(NULL),
+       connectTime(0),
        device(NULL),
        genicam(NULL),
-       payload(0),
        mEnableCaching(enableCaching),
-       nConsecutiveBadFrames(0),
-       nBadFramesPrior(0),
+       lastTransferredBytes(0),
+       lastCpuTime(0),
+       lastCpuFrames(0),
+       liveCounter(0),
+       ringBytes(0),
+       ringPostRemaining(0),
+       ringFlushPending(false),
+       arrayPool(NULL),
+       writeEvent(NULL),
+       pasynUserWrite(NULL),
+       eventQId(NULL),
+       reconfigPending(false),
+       replaying(false),
+       replayEvent(NULL),
        pollingLoop(*this, 
                    "aravisPoll", 
                    stackSize>0 ? stackSize : epicsThreadGetStackSize(epicsThreadStackMedium), 
@@ -332,14 +1239,32 @@ ADAravis::ADAravis(const char *portName, const char *cameraName, int enableCachi
     /* glib initialisation */
     //g_type_init ();
 
+    /* The frame buffers come from a pool that can lock their memory. The pool the base class made is
+     * not used, so it allocates nothing, and the pool readbacks and NDPoolEmptyFreeList use this one */
+    this->arrayPool = new arvArrayPool(this, maxMemory);
+    this->pNDArrayPool = this->arrayPool;
+
     /* Duplicate camera name so we can use it if we reconnect */
     this->cameraName = epicsStrDup(cameraName);
 
-    /* Create a message queue to hold completed frames */
-    this->msgQId = epicsMessageQueueCreate(NRAW, sizeof(ArvBuffer*));
-    if (!this->msgQId) {
-        printf("%s:%s: epicsMessageQueueCreate failure\n", driverName, functionName);
-        return;
+    /* Create the streams, each with a message queue to hold completed frames */
+    if (numStreams < 1) numStreams = 1;
+    for (int i=0; i<numStreams; i++) {
+        aravisStream *pStream = new aravisStream(this, i, stackSize);
+        if (!pStream->msgQId) {
+            printf("%s:%s: epicsMessageQueueCreate failure\n", driverName, functionName);
+            return;
+        }
+        this->streams.push_back(pStream);
+    }
+    /* ADGenICam makes the port with the addresses it was given, so there may be none for the other streams */
+    if (numStreams > this->maxAddr) {
+        printf("%s:%s: the port has %d NDArray address(es), streams %d to %d are not delivered to plugins\n",
+               driverName, functionName, this->maxAddr, this->maxAddr, numStreams - 1);
+    }
+
+    for (int i=0; i<NUM_EVENTS; i++) {
+        this->eventIds[i] = -1;
     }
 
     /* Create some custom parameters */
@@ -354,6 +1279,114 @@ ADAravis::ADAravis(const char *portName, const char *cameraName, int enableCachi
     createParam("ARAVIS_CONVERT_PIXEL_FORMAT", asynParamInt32,   &AravisConvertPixelFormat);
     createParam("ARAVIS_SHIFT_DIR",      asynParamInt32,   &AravisShiftDir);
     createParam("ARAVIS_SHIFT_BITS",     asynParamInt32,   &AravisShiftBits);
+    createParam("ARAVIS_LUT_MODE",       asynParamInt32,   &AravisLUTMode);
+    createParam("ARAVIS_LUT_MIN",        asynParamInt32,   &AravisLUTMin);
+    createParam("ARAVIS_LUT_MAX",        asynParamInt32,   &AravisLUTMax);
+    createParam("ARAVIS_LUT_GAMMA",      asynParamFloat64, &AravisLUTGamma);
+    createParam("ARAVIS_SW_BIN",         asynParamInt32,   &AravisSWBin);
+    createParam("ARAVIS_SW_BIN_MODE",    asynParamInt32,   &AravisSWBinMode);
+    createParam("ARAVIS_SW_DECIMATE",    asynParamInt32,   &AravisSWDecimate);
+    createParam("ARAVIS_SW_MIN_X",       asynParamInt32,   &AravisSWMinX);
+    createParam("ARAVIS_SW_MIN_Y",       asynParamInt32,   &AravisSWMinY);
+    createParam("ARAVIS_SW_SIZE_X",      asynParamInt32,   &AravisSWSizeX);
+    createParam("ARAVIS_SW_SIZE_Y",      asynParamInt32,   &AravisSWSizeY);
+    createParam("ARAVIS_NUM_STREAMS",    asynParamInt32,   &AravisNumStreams);
+    createParam("ARAVIS_NUM_BUFFERS",    asynParamInt32,   &AravisNumBuffers);
+    createParam("ARAVIS_USB_MODE",       asynParamInt32,   &AravisUSBMode);
+    createParam("ARAVIS_USB_MAX_TRANSFER", asynParamInt32, &AravisUSBMaxTransfer);
+    createParam("ARAVIS_TRANSFERRED_BYTES", asynParamFloat64, &AravisTransferredBytes);
+    createParam("ARAVIS_IGNORED_BYTES",  asynParamFloat64, &AravisIgnoredBytes);
+    createParam("ARAVIS_TRANSFER_RATE",  asynParamFloat64, &AravisTransferRate);
+    createParam("ARAVIS_PKT_SOCKET",     asynParamInt32,   &AravisPktSocket);
+    createParam("ARAVIS_PKT_SOCKET_ACTIVE", asynParamInt32, &AravisPktSocketActive);
+    createParam("ARAVIS_SOCKET_BUFFER_SIZE", asynParamInt32, &AravisSocketBufferSize);
+    createParam("ARAVIS_CPU_PER_FRAME",  asynParamFloat64, &AravisCpuPerFrame);
+    createParam("ARAVIS_OVERFLOW_POLICY", asynParamInt32,  &AravisOverflowPolicy);
+    createParam("ARAVIS_QUEUE_SIZE",     asynParamInt32,   &AravisQueueSize);
+    createParam("ARAVIS_DROPPED_NEWEST", asynParamInt32,   &AravisDroppedNewest);
+    createParam("ARAVIS_DROPPED_OLDEST", asynParamInt32,   &AravisDroppedOldest);
+    createParam("ARAVIS_QUEUE_BLOCKED",  asynParamInt32,   &AravisQueueBlocked);
+    createParam("ARAVIS_QUEUE_HIGH_WATER", asynParamInt32, &AravisQueueHighWater);
+    createParam("ARAVIS_STREAM_INPUT",   asynParamInt32,   &AravisStreamInput);
+    createParam("ARAVIS_STREAM_OUTPUT",  asynParamInt32,   &AravisStreamOutput);
+    createParam("ARAVIS_QUEUE_PENDING",  asynParamInt32,   &AravisQueuePending);
+    createParam("ARAVIS_HELD_DOWNSTREAM", asynParamInt32,  &AravisHeldDownstream);
+    createParam("ARAVIS_ALLOC_FAILURES", asynParamInt32,   &AravisAllocFailures);
+    createParam("ARAVIS_BACK_PRESSURE",  asynParamInt32,   &AravisBackPressure);
+    createParam("ARAVIS_MIN_BUFFERS",    asynParamInt32,   &AravisMinBuffers);
+    createParam("ARAVIS_THROTTLE",       asynParamFloat64, &AravisThrottle);
+    createParam("ARAVIS_THROTTLED",      asynParamInt32,   &AravisThrottled);
+    createParam("ARAVIS_BUFFER_DEFICIT", asynParamInt32,   &AravisBufferDeficit);
+    createParam("ARAVIS_RESERVE_DROPS",  asynParamInt32,   &AravisReserveDrops);
+    createParam("ARAVIS_STATUS_RATE",    asynParamFloat64, &AravisStatusRate);
+    createParam("ARAVIS_LIVE_DECIMATE",  asynParamInt32,   &AravisLiveDecimate);
+    createParam("ARAVIS_LIVE_MAX_RATE",  asynParamFloat64, &AravisLiveMaxRate);
+    createParam("ARAVIS_LIVE_ADDRESS",   asynParamInt32,   &AravisLiveAddress);
+    createParam("ARAVIS_ASYNC_WRITES",   asynParamInt32,   &AravisAsyncWrites);
+    createParam("ARAVIS_WRITE_LATENCY",  asynParamFloat64, &AravisWriteLatency);
+    createParam("ARAVIS_WRITES_DONE",    asynParamInt32,   &AravisWritesDone);
+    createParam("ARAVIS_WRITES_COALESCED", asynParamInt32, &AravisWritesCoalesced);
+    createParam("ARAVIS_RING",           asynParamInt32,   &AravisRing);
+    createParam("ARAVIS_RING_MEMORY",    asynParamFloat64, &AravisRingMemory);
+    createParam("ARAVIS_RING_POST_FRAMES", asynParamInt32, &AravisRingPostFrames);
+    createParam("ARAVIS_RING_TRIGGER",   asynParamInt32,   &AravisRingTrigger);
+    createParam("ARAVIS_RING_FRAMES",    asynParamInt32,   &AravisRingFrames);
+    createParam("ARAVIS_LIVE_RECONFIG",  asynParamInt32,   &AravisLiveReconfig);
+    createParam("ARAVIS_RECONFIG_TIME",  asynParamFloat64, &AravisReconfigTime);
+    createParam("ARAVIS_RECONFIG_COUNT", asynParamInt32,   &AravisReconfigCount);
+    createParam("ARAVIS_ARENA",          asynParamInt32,   &AravisArena);
+    createParam("ARAVIS_ARENA_NUMA_NODE", asynParamInt32,  &AravisArenaNumaNode);
+    createParam("ARAVIS_ARENA_LOCKED",   asynParamFloat64, &AravisArenaLocked);
+    createParam("ARAVIS_RECORD",         asynParamInt32,   &AravisRecord);
+    createParam("ARAVIS_RECORD_ONLY",    asynParamInt32,   &AravisRecordOnly);
+    createParam("ARAVIS_RECORD_BUFFER",  asynParamInt32,   &AravisRecordBuffer);
+    createParam("ARAVIS_RECORD_DIRECT",  asynParamInt32,   &AravisRecordDirect);
+    createParam("ARAVIS_RECORD_FRAMES",  asynParamInt32,   &AravisRecordFrames);
+    createParam("ARAVIS_RECORD_DROPPED", asynParamInt32,   &AravisRecordDropped);
+    createParam("ARAVIS_RECORD_RATE",    asynParamFloat64, &AravisRecordRate);
+    createParam("ARAVIS_SHM",            asynParamInt32,   &AravisShm);
+    createParam("ARAVIS_SHM_NAME",       asynParamOctet,   &AravisShmName);
+    createParam("ARAVIS_SHM_SLOTS",      asynParamInt32,   &AravisShmSlots);
+    createParam("ARAVIS_SHM_FRAMES",     asynParamInt32,   &AravisShmFrames);
+    createParam("ARAVIS_SHM_SKIPPED",    asynParamInt32,   &AravisShmSkipped);
+    createParam("ARAVIS_STATS",          asynParamInt32,   &AravisStats);
+    createParam("ARAVIS_STATS_FULL_SCALE", asynParamInt32, &AravisStatsFullScale);
+    createParam("ARAVIS_STATS_HIST_SIZE", asynParamInt32,  &AravisStatsHistSize);
+    createParam("ARAVIS_STATS_MIN",      asynParamFloat64, &AravisStatsMin);
+    createParam("ARAVIS_STATS_MAX",      asynParamFloat64, &AravisStatsMax);
+    createParam("ARAVIS_STATS_MEAN",     asynParamFloat64, &AravisStatsMean);
+    createParam("ARAVIS_STATS_SUM",      asynParamFloat64, &AravisStatsSum);
+    createParam("ARAVIS_STATS_SATURATED", asynParamFloat64, &AravisStatsSaturated);
+    createParam("ARAVIS_STATS_HIST",     asynParamInt32Array, &AravisStatsHist);
+    createParam("ARAVIS_BULK_APPLY",     asynParamInt32,   &AravisBulkApply);
+    createParam("ARAVIS_BULK_APPLY_TIME", asynParamFloat64, &AravisBulkApplyTime);
+    createParam("ARAVIS_BULK_WRITTEN",   asynParamInt32,   &AravisBulkWritten);
+    createParam("ARAVIS_BULK_SKIPPED",   asynParamInt32,   &AravisBulkSkipped);
+    createParam("ARAVIS_EVENTS",         asynParamInt32,   &AravisEvents);
+    createParam("ARAVIS_EVENTS_ACTIVE",  asynParamInt32,   &AravisEventsActive);
+    createParam("ARAVIS_CONNECT_TIME",   asynParamFloat64, &AravisConnectTime);
+    createParam("ARAVIS_SOFT_TRIGGER",   asynParamInt32,   &AravisSoftTrigger);
+    createParam("ARAVIS_TRIGGER_COUNT",  asynParamInt32,   &AravisTriggerCount);
+    createParam("ARAVIS_TRIGGER_MISSED", asynParamInt32,   &AravisTriggerMissed);
+    createParam("ARAVIS_TRIGGER_LATENCY", asynParamFloat64, &AravisTriggerLatency);
+    createParam("ARAVIS_TRIGGER_LATENCY_MEAN", asynParamFloat64, &AravisTriggerLatencyMean);
+    createParam("ARAVIS_TRIGGER_LATENCY_MAX", asynParamFloat64, &AravisTriggerLatencyMax);
+    createParam("ARAVIS_TRIGGER_HIST_BIN", asynParamFloat64, &AravisTriggerHistBin);
+    createParam("ARAVIS_TRIGGER_HIST",   asynParamInt32Array, &AravisTriggerHist);
+    createParam("ARAVIS_TRIGGER_RESET",  asynParamInt32,   &AravisTriggerReset);
+    createParam("ARAVIS_REPLAY",         asynParamInt32,   &AravisReplay);
+    createParam("ARAVIS_REPLAY_FILE",    asynParamOctet,   &AravisReplayFile);
+    createParam("ARAVIS_REPLAY_MODE",    asynParamInt32,   &AravisReplayMode);
+    createParam("ARAVIS_REPLAY_LOOP",    asynParamInt32,   &AravisReplayLoop);
+    createParam("ARAVIS_REPLAY_FRAMES",  asynParamInt32,   &AravisReplayFrames);
+    createParam("ARAVIS_REPLAY_RATE",    asynParamFloat64, &AravisReplayRate);
+    createParam("ARAVIS_REPLAY_TIME",    asynParamFloat64, &AravisReplayTime);
+    for (int i=0; i<NUM_EVENTS; i++) {
+        epicsSnprintf(tempString, sizeof(tempString), "ARAVIS_EVENT_COUNT_%s", event_lookup[i].param);
+        createParam(tempString,          asynParamInt32,   &AravisEventCount[i]);
+        epicsSnprintf(tempString, sizeof(tempString), "ARAVIS_EVENT_TIME_%s", event_lookup[i].param);
+        createParam(tempString,          asynParamFloat64, &AravisEventTime[i]);
+    }
     createParam("ARAVIS_CONNECTION",     asynParamInt32,   &AravisConnection);
     createParam("ARAVIS_RESET",          asynParamInt32,   &AravisReset);
 
@@ -376,14 +1409,152 @@ ADAravis::ADAravis(const char *portName, const char *cameraName, int enableCachi
     setIntegerParam(AravisConvertPixelFormat, AravisConvertPixelFormatMono16Low);
     setIntegerParam(AravisShiftDir, 0);
     setIntegerParam(AravisShiftBits, 4);
+    setIntegerParam(AravisLUTMode, AravisLUTOff);
+    setIntegerParam(AravisLUTMin, 0);
+    setIntegerParam(AravisLUTMax, 65535);
+    setDoubleParam(AravisLUTGamma, 1.);
+    this->buildLUT();
+    setIntegerParam(AravisSWBin, 1);
+    setIntegerParam(AravisSWBinMode, AravisSWBinMean);
+    setIntegerParam(AravisSWDecimate, 1);
+    setIntegerParam(AravisSWMinX, 0);
+    setIntegerParam(AravisSWMinY, 0);
+    setIntegerParam(AravisSWSizeX, 0);
+    setIntegerParam(AravisSWSizeY, 0);
+    setIntegerParam(AravisNumStreams, numStreams);
+    setIntegerParam(AravisNumBuffers, NRAW);
+    setIntegerParam(AravisUSBMode, AravisUSBModeDefault);
+    setIntegerParam(AravisUSBMaxTransfer, 0);
+    setDoubleParam(AravisTransferredBytes, 0);
+    setDoubleParam(AravisIgnoredBytes, 0);
+    setDoubleParam(AravisTransferRate, 0);
+    epicsTimeGetCurrent(&this->lastTransferTime);
+    setIntegerParam(AravisPktSocket, AravisPktSocketAuto);
+    setIntegerParam(AravisPktSocketActive, 0);
+    setIntegerParam(AravisSocketBufferSize, 0);
+    setDoubleParam(AravisCpuPerFrame, 0);
+    this->lastCpuTime = 0;
+    epicsTimeGetCurrent(&this->lastCpuSample);
+    setIntegerParam(AravisOverflowPolicy, this->overflowPolicy);
+    setIntegerParam(AravisQueueSize, this->queueSize);
+    setIntegerParam(AravisDroppedNewest, 0);
+    setIntegerParam(AravisDroppedOldest, 0);
+    setIntegerParam(AravisQueueBlocked, 0);
+    setIntegerParam(AravisQueueHighWater, 0);
+    setIntegerParam(AravisStreamInput, 0);
+    setIntegerParam(AravisStreamOutput, 0);
+    setIntegerParam(AravisQueuePending, 0);
+    setIntegerParam(AravisHeldDownstream, 0);
+    setIntegerParam(AravisAllocFailures, 0);
+    setIntegerParam(AravisBackPressure, 0);
+    setIntegerParam(AravisMinBuffers, 3);
+    setDoubleParam(AravisThrottle, 0);
+    setIntegerParam(AravisThrottled, 0);
+    setIntegerParam(AravisBufferDeficit, 0);
+    setIntegerParam(AravisReserveDrops, 0);
+    this->throttled = false;
+    this->throttleRate = 0;
+    setDoubleParam(AravisStatusRate, 10.);
+    setIntegerParam(AravisLiveDecimate, 0);
+    setDoubleParam(AravisLiveMaxRate, 0);
+    /* The live view frames come after the streams */
+    setIntegerParam(AravisLiveAddress, numStreams);
+    epicsTimeGetCurrent(&this->lastLiveTime);
+    setIntegerParam(AravisAsyncWrites, 0);
+    setDoubleParam(AravisWriteLatency, 0);
+    setIntegerParam(AravisWritesDone, 0);
+    setIntegerParam(AravisWritesCoalesced, 0);
+    setIntegerParam(AravisRing, 0);
+    setDoubleParam(AravisRingMemory, 1000.);
+    setIntegerParam(AravisRingPostFrames, 0);
+    setIntegerParam(AravisRingTrigger, 0);
+    setIntegerParam(AravisRingFrames, 0);
+    setIntegerParam(AravisLiveReconfig, 1);
+    setDoubleParam(AravisReconfigTime, 0);
+    setIntegerParam(AravisReconfigCount, 0);
+    setIntegerParam(AravisArena, this->arenaMode);
+    setIntegerParam(AravisArenaNumaNode, this->arenaNumaNode);
+    setDoubleParam(AravisArenaLocked, 0);
+    this->recording = false;
+    setIntegerParam(AravisRecord, 0);
+    setIntegerParam(AravisRecordOnly, 0);
+    setIntegerParam(AravisRecordBuffer, 512);
+    setIntegerParam(AravisRecordDirect, 0);
+    setIntegerParam(AravisRecordFrames, 0);
+    setIntegerParam(AravisRecordDropped, 0);
+    setDoubleParam(AravisRecordRate, 0);
+    setIntegerParam(AravisShm, AravisShmOff);
+    /* An empty name means /<portName> */
+    setStringParam(AravisShmName, "");
+    setIntegerParam(AravisShmSlots, 8);
+    setIntegerParam(AravisShmFrames, 0);
+    setIntegerParam(AravisShmSkipped, 0);
+    setIntegerParam(AravisStats, 0);
+    setIntegerParam(AravisStatsFullScale, 0);
+    setIntegerParam(AravisStatsHistSize, 64);
+    setDoubleParam(AravisStatsMin, 0);
+    setDoubleParam(AravisStatsMax, 0);
+    setDoubleParam(AravisStatsMean, 0);
+    setDoubleParam(AravisStatsSum, 0);
+    setDoubleParam(AravisStatsSaturated, 0);
+    this->statsHistNew = false;
+    /* With aravisBulkRestore, collect the feature writes done by autosave and PINI while the IOC starts.
+     * They are applied after iocInit */
+    setIntegerParam(AravisBulkApply, bulkRestore ? 1 : 0);
+    setDoubleParam(AravisBulkApplyTime, 0);
+    setIntegerParam(AravisBulkWritten, 0);
+    setIntegerParam(AravisBulkSkipped, 0);
+    setIntegerParam(AravisEvents, 0);
+    setIntegerParam(AravisEventsActive, 0);
+    setDoubleParam(AravisConnectTime, 0);
+    this->triggerNode = NULL;
+    this->triggerRequests = 0;
+    this->triggerHistBin = 0.1;
+    this->triggerHist.assign(TRIGGER_HIST_SIZE, 0);
+    this->resetTriggerStatistics();
+    setIntegerParam(AravisSoftTrigger, 0);
+    setDoubleParam(AravisTriggerHistBin, this->triggerHistBin);
+    setIntegerParam(AravisTriggerReset, 0);
+    setIntegerParam(AravisReplay, 0);
+    setStringParam(AravisReplayFile, "");
+    setIntegerParam(AravisReplayMode, AravisReplayOriginal);
+    setIntegerParam(AravisReplayLoop, 0);
+    setIntegerParam(AravisReplayFrames, 0);
+    setDoubleParam(AravisReplayRate, 0);
+    setDoubleParam(AravisReplayTime, 0);
+    for (int i=0; i<NUM_EVENTS; i++) {
+        setIntegerParam(AravisEventCount[i], 0);
+        setDoubleParam(AravisEventTime[i], 0);
+    }
     setIntegerParam(AravisReset, 0);
     
+    /* Create a message queue for the device events, so the aravis callback does not take the lock */
+    this->eventQId = epicsMessageQueueCreate(MAX_NRAW, sizeof(struct device_event));
+    if (!this->eventQId) {
+        printf("%s:%s: epicsMessageQueueCreate failure for events\n", driverName, functionName);
+        return;
+    }
+
     /* Enable the fake camera for simulations */
     arv_enable_interface ("Fake");
 
-    /* Connect to the camera */
+    /* Connect to the camera, or have a thread do it so the cameras of the IOC connect in parallel */
     this->featureIndex = 0;
-    this->connectToCamera();
+    if (parallelInitTimeout > 0) {
+        this->connectEvent = epicsEventMustCreate(epicsEventEmpty);
+        epicsMutexMustLock(parallelInitLock);
+        parallelInitCameras.push_back(this);
+        epicsMutexUnlock(parallelInitLock);
+        if (epicsThreadCreate("aravisConnect",
+                              epicsThreadPriorityMedium,
+                              stackSize>0 ? stackSize : epicsThreadGetStackSize(epicsThreadStackMedium),
+                              connectTaskC, this) == NULL) {
+            printf("%s:%s: epicsThreadCreate failure for connect task\n", driverName, functionName);
+            this->connectTask();
+        }
+    } else {
+        this->connectTask();
+    }
 
     /* Register the shutdown function for epicsAtExit */
     epicsAtExit(aravisShutdown, (void*)this);
@@ -391,6 +1562,54 @@ ADAravis::ADAravis(const char *portName, const char *cameraName, int enableCachi
     /* Register the pollingLoop to start after iocInit */
     initHookRegister(setIocRunningFlag);
     this->pollingLoop.start();
+    for (auto pStream : this->streams) {
+        if (pStream->thread) pStream->thread->start();
+    }
+
+    /* The statistics are published by a low priority thread so the frame path does not post monitors */
+    this->statusEvent = epicsEventMustCreate(epicsEventEmpty);
+    if (epicsThreadCreate("aravisStatus",
+                          epicsThreadPriorityLow,
+                          stackSize>0 ? stackSize : epicsThreadGetStackSize(epicsThreadStackMedium),
+                          statusTaskC, this) == NULL) {
+        printf("%s:%s: epicsThreadCreate failure for status task\n", driverName, functionName);
+    }
+
+    /* Feature writes can be done by their own thread, so a burst of writes does not hold up the port */
+    this->writeEvent = epicsEventMustCreate(epicsEventEmpty);
+    this->pasynUserWrite = pasynManager->duplicateAsynUser(this->pasynUserSelf, NULL, NULL);
+    if (epicsThreadCreate("aravisWrite",
+                          epicsThreadPriorityMedium,
+                          stackSize>0 ? stackSize : epicsThreadGetStackSize(epicsThreadStackMedium),
+                          writeTaskC, this) == NULL) {
+        printf("%s:%s: epicsThreadCreate failure for write task\n", driverName, functionName);
+    }
+
+    /* The events are published by a high priority thread so they arrive before the frame */
+    if (epicsThreadCreate("aravisEvent",
+                          epicsThreadPriorityHigh,
+                          stackSize>0 ? stackSize : epicsThreadGetStackSize(epicsThreadStackMedium),
+                          eventTaskC, this) == NULL) {
+        printf("%s:%s: epicsThreadCreate failure for event task\n", driverName, functionName);
+    }
+
+    /* Software triggers are sent by the highest priority thread, without the lock */
+    this->triggerEvent = epicsEventMustCreate(epicsEventEmpty);
+    if (epicsThreadCreate("aravisTrigger",
+                          epicsThreadPriorityMax,
+                          stackSize>0 ? stackSize : epicsThreadGetStackSize(epicsThreadStackMedium),
+                          triggerTaskC, this) == NULL) {
+        printf("%s:%s: epicsThreadCreate failure for trigger task\n", driverName, functionName);
+    }
+
+    /* Raw captures are replayed by their own thread, so the port can stop the replay */
+    this->replayEvent = epicsEventMustCreate(epicsEventEmpty);
+    if (epicsThreadCreate("aravisReplay",
+                          epicsThreadPriorityMedium,
+                          stackSize>0 ? stackSize : epicsThreadGetStackSize(epicsThreadStackMedium),
+                          replayTaskC, this) == NULL) {
+        printf("%s:%s: epicsThreadCreate failure for replay task\n", driverName, functionName);
+    }
 }
 
 asynStatus ADAravis::makeCameraObject() {
@@ -421,11 +1640,20 @@ asynStatus ADAravis::makeCameraObject() {
 
     /* connect to camera */
     printf ("ADAravis: Looking for camera '%s'... \n", this->cameraName);
+#if ARAVIS_VERSION_CURRENT >= ARAVIS_VERSION_INT(0, 8, 6)
+    /* Look it up in the camera list shared by the IOC, rather than enumerating every interface */
+    ArvDevice *pDevice = arvDiscovery::instance()->openDevice(this->cameraName, err.get());
+    if (pDevice != NULL) {
+        this->camera = arv_camera_new_with_device (pDevice, err.get());
+        g_object_unref(pDevice);
+    }
+#else
     this->camera = arv_camera_new (this->cameraName, err.get());
+#endif
     if (this->camera == NULL) {
         asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
                     "%s:%s: No camera found, err=%s\n",
-                    driverName, functionName, err->message);
+                    driverName, functionName, err ? err->message : "");
         return asynError;
     }
     /* Store device */
@@ -456,62 +1684,203 @@ asynStatus ADAravis::makeCameraObject() {
     return asynSuccess;
 }
 
+/** Return the name of the SFNC feature that selects the stream channel, or NULL if the camera has none */
+const char *ADAravis::getStreamSelector() {
+    if (arv_device_is_feature_available(this->device, "DeviceStreamChannelSelector", NULL))
+        return "DeviceStreamChannelSelector";
+    if (arv_device_is_feature_available(this->device, "GevStreamChannelSelector", NULL))
+        return "GevStreamChannelSelector";
+    return NULL;
+}
+
+/** Create the aravis stream for stream channel index.
+  * Channels other than 0 are selected with the stream channel selector while the stream is created.
+  * The Fake camera has no selector, it just creates another independent stream. */
+ArvStream *ADAravis::createStream(int index, GError **err) {
+    const char *functionName = "createStream";
+    const char *selector = NULL;
+    ArvStream *stream;
+
+    if (index > 0) {
+        selector = this->getStreamSelector();
+        if (selector != NULL) {
+            arv_device_set_integer_feature_value(this->device, selector, index, err);
+            if (*err) return NULL;
+        } else if (!ARV_IS_FAKE_DEVICE(this->device)) {
+            asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+                        "%s:%s: Camera has no stream channel selector, cannot make stream %d\n",
+                        driverName, functionName, index);
+            return NULL;
+        }
+    }
+    stream = arv_camera_create_stream (this->camera, NULL, NULL, err);
+    /* Leave the selector on stream 0 so other features refer to it */
+    if (selector != NULL) {
+        arv_device_set_integer_feature_value(this->device, selector, 0, NULL);
+    }
+    return stream;
+}
+
+/** Return the payload size of stream channel index */
+int ADAravis::getStreamPayload(int index) {
+    GErrorHelper err;
+    const char *selector = NULL;
+    int payload;
+
+    if (index > 0) {
+        selector = this->getStreamSelector();
+        if (selector != NULL) arv_device_set_integer_feature_value(this->device, selector, index, NULL);
+    }
+    payload = arv_camera_get_payload(this->camera, err.get());
+    if (selector != NULL) {
+        arv_device_set_integer_feature_value(this->device, selector, 0, NULL);
+    }
+    return payload;
+}
+
 asynStatus ADAravis::makeStreamObject() {
     const char *functionName = "makeStreamObject";
     asynStatus status = asynSuccess;
     GErrorHelper err;
     
-    /* remove old stream if it exists */
-    if (this->stream != NULL) {
-        arv_stream_set_emit_signals (this->stream, FALSE);
-        g_object_unref(this->stream);
-        this->stream = NULL;
-    }
-    this->stream = arv_camera_create_stream (this->camera, NULL, NULL, err.get());
-    if (this->stream == NULL) {
-        asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
-                    "%s:%s: Making stream failed, err=%s, retrying in 5s...\n",
-                    driverName, functionName, err->message);
-        epicsThreadSleep(5);
-        /* make the camera object */
-        status = this->makeCameraObject();
-        if (status != asynSuccess) return status;
-        /* Make the stream */
-        this->stream = arv_camera_create_stream (this->camera, NULL, NULL, err.get());
-    }
-    if (this->stream == NULL) {
-        asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
-                    "%s:%s: Making stream failed, err=%s\n",
-                    driverName, functionName, err->message);
-        return asynError;
+    /* remove old streams if they exist. The camera is stopped first, and the frames the stream still
+     * holds are freed, so nothing is delivered to a stream that is going away */
+    if ((this->streams[0]->stream != NULL) && (this->camera != NULL)) {
+        arv_camera_stop_acquisition(this->camera, NULL);
     }
+    for (auto pStream : this->streams) {
+        if (pStream->stream != NULL) {
+            ArvBuffer *buffer;
+            arv_stream_set_emit_signals (pStream->stream, FALSE);
+            while ((buffer = arv_stream_try_pop_buffer(pStream->stream)) != NULL) {
+                g_object_unref(buffer);
+            }
+            g_object_unref(pStream->stream);
+            pStream->stream = NULL;
+        }
+    }
+
+    /* The GigE packet socket option is read by aravis when the stream is created.
+     * Only ask for it when we have the capability, so the receive mode we report is the one aravis uses */
+    if (ARV_IS_GV_DEVICE(this->device)) {
+        epicsInt32 pktSocket;
+        bool usePktSocket;
+        getIntegerParam(AravisPktSocket, &pktSocket);
+        usePktSocket = (pktSocket == AravisPktSocketAuto) && packetSocketAvailable();
+        if ((pktSocket == AravisPktSocketAuto) && !usePktSocket) {
+            asynPrint(this->pasynUserSelf, ASYN_TRACE_WARNING,
+                        "%s:%s: no CAP_NET_RAW capability for packet sockets, using UDP sockets\n",
+                        driverName, functionName);
+        }
+        arv_gv_device_set_stream_options(ARV_GV_DEVICE(this->device),
+                                         usePktSocket ? ARV_GV_STREAM_OPTION_NONE : ARV_GV_STREAM_OPTION_PACKET_SOCKET_DISABLED);
+        setIntegerParam(AravisPktSocketActive, usePktSocket ? 1 : 0);
+    }
+
+    /* The USB mode is read by aravis when the stream is created */
+    epicsInt32 usbMode;
+    getIntegerParam(AravisUSBMode, &usbMode);
+    if ((usbMode != AravisUSBModeDefault) && ARV_IS_UV_DEVICE(this->device)) {
+#if ARAVIS_VERSION_CURRENT >= ARAVIS_VERSION_INT(0, 8, 8)
+        arv_uv_device_set_usb_mode(ARV_UV_DEVICE(this->device),
+                                   usbMode == AravisUSBModeSync ? ARV_UV_USB_MODE_SYNC : ARV_UV_USB_MODE_ASYNC);
+#else
+        asynPrint(this->pasynUserSelf, ASYN_TRACE_WARNING,
+                    "%s:%s: this version of aravis cannot set the USB mode\n",
+                    driverName, functionName);
+#endif
+    }
+    for (auto pStream : this->streams) {
+        /* The frames still queued from the old stream are processed, but their buffers are not reused */
+        pStream->generation++;
+        pStream->receiveTid = 0;
+        pStream->stream = this->createStream(pStream->index, err.get());
+        if ((pStream->stream == NULL) && (pStream->index == 0)) {
+            asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+                        "%s:%s: Making stream failed, err=%s, retrying in 5s...\n",
+                        driverName, functionName, err ? err->message : "");
+            epicsThreadSleep(5);
+            /* make the camera object */
+            status = this->makeCameraObject();
+            if (status != asynSuccess) return status;
+            /* Make the stream */
+            g_clear_error(err.get());
+            pStream->stream = this->createStream(pStream->index, err.get());
+        }
+        if (pStream->stream == NULL) {
+            asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+                        "%s:%s: Making stream %d failed, err=%s\n",
+                        driverName, functionName, pStream->index, err ? err->message : "");
+            return asynError;
+        }
     
-    if (ARV_IS_GV_DEVICE(this->stream)) {
-        /* configure the stream */
-        // Available stream options:
-        //  socket-buffer:      ARV_GV_STREAM_SOCKET_BUFFER_FIXED, ARV_GV_STREAM_SOCKET_BUFFER_AUTO, defaults to auto which follows arvgvbuffer size
-        //  socket-buffer-size: 64 bit int, Defaults to -1
-        //  packet-resend:      ARV_GV_STREAM_PACKET_RESEND_NEVER, ARV_GV_STREAM_PACKET_RESEND_ALWAYS, defaults to always
-        //  packet-timeout:     64 bit int, units us, ARV_GV_STREAM default 40000
-        //  frame-retention:    64 bit int, units us, ARV_GV_STREAM default 200000
-    
-        epicsInt32      FrameRetention, PktResend, PktTimeout;
-        getIntegerParam(AravisFrameRetention,  &FrameRetention);
-        getIntegerParam(AravisPktResend,       &PktResend);
-        getIntegerParam(AravisPktTimeout,      &PktTimeout);
-        g_object_set (ARV_GV_STREAM (this->stream),
-                  "packet-resend",      (guint64) PktResend,
-                  "packet-timeout",     (guint64) PktTimeout,
-                  "frame-retention",    (guint64) FrameRetention,
-                  NULL);
-    }
-
-    // Enable callback on new buffers
-    arv_stream_set_emit_signals (this->stream, TRUE);
-    g_signal_connect (this->stream, "new-buffer", G_CALLBACK (newBufferCallbackC), this);
+        if (ARV_IS_GV_STREAM(pStream->stream)) {
+            /* configure the stream */
+            // Available stream options:
+            //  socket-buffer:      ARV_GV_STREAM_SOCKET_BUFFER_FIXED, ARV_GV_STREAM_SOCKET_BUFFER_AUTO, defaults to auto which follows arvgvbuffer size
+            //  socket-buffer-size: 64 bit int, Defaults to -1
+            //  packet-resend:      ARV_GV_STREAM_PACKET_RESEND_NEVER, ARV_GV_STREAM_PACKET_RESEND_ALWAYS, defaults to always
+            //  packet-timeout:     64 bit int, units us, ARV_GV_STREAM default 40000
+            //  frame-retention:    64 bit int, units us, ARV_GV_STREAM default 200000
+        
+            epicsInt32      FrameRetention, PktResend, PktTimeout, SocketBufferSize;
+            getIntegerParam(AravisFrameRetention,  &FrameRetention);
+            getIntegerParam(AravisPktResend,       &PktResend);
+            getIntegerParam(AravisPktTimeout,      &PktTimeout);
+            getIntegerParam(AravisSocketBufferSize, &SocketBufferSize);
+            g_object_set (ARV_GV_STREAM (pStream->stream),
+                      "packet-resend",      (guint64) PktResend,
+                      "packet-timeout",     (guint64) PktTimeout,
+                      "frame-retention",    (guint64) FrameRetention,
+                      NULL);
+            /* Only used by UDP sockets, aravis sizes the packet socket ring itself */
+            if (SocketBufferSize > 0) {
+                g_object_set (ARV_GV_STREAM (pStream->stream),
+                          "socket-buffer",      ARV_GV_STREAM_SOCKET_BUFFER_FIXED,
+                          "socket-buffer-size", (gint64) SocketBufferSize,
+                          NULL);
+            }
+        }
+
+        if (ARV_IS_UV_STREAM(pStream->stream)) {
+            /* The maximum transfer size is only a property of the stream in some versions of aravis */
+            epicsInt32 maxTransfer;
+            getIntegerParam(AravisUSBMaxTransfer, &maxTransfer);
+            if (maxTransfer > 0) {
+                if (g_object_class_find_property(G_OBJECT_GET_CLASS(pStream->stream), "maximum-transfer-size")) {
+                    g_object_set (G_OBJECT (pStream->stream), "maximum-transfer-size", (guint) maxTransfer, NULL);
+                } else {
+                    asynPrint(this->pasynUserSelf, ASYN_TRACE_WARNING,
+                                "%s:%s: this version of aravis cannot set the USB maximum transfer size, using the default\n",
+                                driverName, functionName);
+                }
+            }
+        }
+
+        // Enable callback on new buffers
+        arv_stream_set_emit_signals (pStream->stream, TRUE);
+        g_signal_connect (pStream->stream, "new-buffer", G_CALLBACK (newBufferCallbackC), pStream);
+    }
     return asynSuccess;
 }
 
+/** Connect to the camera when the driver is made, timing how long it takes.
+    Called by aravisConfig, or by the connect thread when the cameras connect in parallel */
+void ADAravis::connectTask() {
+    epicsTimeStamp start, end;
+
+    epicsTimeGetCurrent(&start);
+    this->lock();
+    this->connectToCamera();
+    epicsTimeGetCurrent(&end);
+    this->connectTime = epicsTimeDiffInSeconds(&end, &start);
+    setDoubleParam(AravisConnectTime, this->connectTime);
+    this->unlock();
+    printf("ADAravis: %s %s in %.2f s\n", this->portName,
+           this->connectionValid ? "connected" : "failed to connect", this->connectTime);
+    if (this->connectEvent) epicsEventSignal(this->connectEvent);
+}
+
 asynStatus ADAravis::connectToCamera() {
     //const char *functionName = "connectToCamera";
     asynStatus status = asynSuccess;
@@ -526,6 +1895,11 @@ asynStatus ADAravis::connectToCamera() {
     /* Tell areaDetector it is no longer acquiring */
     setIntegerParam(ADAcquire, 0);
 
+    /* The trigger command belongs to the old camera */
+    this->triggerNodeLock.lock();
+    this->triggerNode = NULL;
+    this->triggerNodeLock.unlock();
+
     /* make the camera object */
     status = this->makeCameraObject();
     if (status) return status;
@@ -550,6 +1924,12 @@ asynStatus ADAravis::connectToCamera() {
         pFeature->initialize(this->device);
     }
 
+    /* Look the software trigger up now, so sending it does not go through the feature lookup */
+    ArvGcNode *triggerNode = arv_device_get_feature(this->device, "TriggerSoftware");
+    this->triggerNodeLock.lock();
+    this->triggerNode = ARV_IS_GC_COMMAND(triggerNode) ? triggerNode : NULL;
+    this->triggerNodeLock.unlock();
+
     /* Make the stream */
     status = this->makeStreamObject();
     if (status) return status;    
@@ -557,6 +1937,14 @@ asynStatus ADAravis::connectToCamera() {
     /* connect connection lost signal to camera */
     g_signal_connect (this->device, "control-lost", G_CALLBACK (controlLostCallback), this);
 
+    /* connect the device event signal, and turn the events back on if they were on before reconnecting */
+    if (g_signal_lookup("device-event", G_OBJECT_TYPE(this->device))) {
+        g_signal_connect (this->device, "device-event", G_CALLBACK (deviceEventCallbackC), this);
+    }
+    int events;
+    getIntegerParam(AravisEvents, &events);
+    if (events) this->enableEvents(events);
+
     /* Mark connection valid again */
     this->connectionValid = 1;
 
@@ -591,11 +1979,207 @@ asynStatus ADAravis::writeInt32(asynUser *pasynUser, epicsInt32 value)
                function == AravisShiftDir || function == AravisShiftBits || function == AravisConvertPixelFormat) {
         /* just write the value for these as they get fetched via getIntegerParam when needed */
         status = setIntegerParam(function, value);
-    } else if ((function < FIRST_ARAVIS_CAMERA_PARAM) || (function > LAST_ARAVIS_CAMERA_PARAM)) {
-        /* If this parameter belongs to a base class call its method */
-        /* GenICam parameters are created after this constructor runs, so they are higher numbers */
-        status = ADGenICam::writeInt32(pasynUser, value);
-    /* generic feature lookup */
+    } else if (function == AravisSWBin) {
+        if ((value == 1) || (value == 2) || (value == 4))
+            status = setIntegerParam(function, value);
+        else
+            status = asynError;
+    } else if (function == AravisNumBuffers) {
+        /* Used the next time acquisition starts */
+        if ((value >= 1) && (value <= MAX_NRAW))
+            status = setIntegerParam(function, value);
+        else
+            status = asynError;
+    } else if (function == AravisUSBMode || function == AravisUSBMaxTransfer ||
+               function == AravisPktSocket || function == AravisSocketBufferSize) {
+        /* Applied when the stream is made, which is done when acquisition stops */
+        if (value >= 0)
+            status = setIntegerParam(function, value);
+        else
+            status = asynError;
+    } else if (function == AravisOverflowPolicy) {
+        if ((value >= AravisOverflowDropNewest) && (value <= AravisOverflowBlock)) {
+            this->overflowPolicy = value;
+            status = setIntegerParam(function, value);
+        } else {
+            status = asynError;
+        }
+    } else if (function == AravisQueueSize) {
+        if ((value >= 1) && (value <= MAX_NRAW)) {
+            this->queueSize = value;
+            status = setIntegerParam(function, value);
+        } else {
+            status = asynError;
+        }
+    } else if (function == AravisAsyncWrites) {
+        /* Do any queued writes before changing mode */
+        while (this->doFeatureWrite());
+        status = setIntegerParam(function, value ? 1 : 0);
+    } else if (function == AravisArena) {
+        /* Buffers already prepared stay prepared, the pool reuses them */
+        if ((value >= AravisArenaOff) && (value <= AravisArenaHugePages)) {
+            this->arenaMode = value;
+            status = setIntegerParam(function, value);
+        } else {
+            status = asynError;
+        }
+    } else if (function == AravisArenaNumaNode) {
+        if (value >= -1) {
+            this->arenaNumaNode = value;
+            status = setIntegerParam(function, value);
+        } else {
+            status = asynError;
+        }
+    } else if (function == AravisRing) {
+        /* Turning the ring off discards what it holds */
+        if (!value) this->ringClear();
+        status = setIntegerParam(function, value ? 1 : 0);
+    } else if (function == AravisRingPostFrames) {
+        if (value >= 0)
+            status = setIntegerParam(function, value);
+        else
+            status = asynError;
+    } else if (function == AravisRingTrigger) {
+        /* Stream 0 flushes the ring, then processes the post-trigger frames. This also works after stopping */
+        if (value) {
+            getIntegerParam(AravisRingPostFrames, &this->ringPostRemaining);
+            this->ringFlushPending = true;
+            status = setIntegerParam(function, 1);
+        }
+    } else if (function == AravisLUTMode || function == AravisLUTMin || function == AravisLUTMax) {
+        if (((function == AravisLUTMode) && (value >= AravisLUTOff) && (value <= AravisLUTLog)) ||
+            ((function != AravisLUTMode) && (value >= 0) && (value <= 65535))) {
+            status = setIntegerParam(function, value);
+            this->buildLUT();
+        } else {
+            status = asynError;
+        }
+    } else if (function == AravisSoftTrigger) {
+        /* Sent by the trigger thread, so this does not wait for the camera */
+        this->triggerNodeLock.lock();
+        bool haveTrigger = (this->triggerNode != NULL);
+        this->triggerNodeLock.unlock();
+        if (!haveTrigger) {
+            asynPrint(pasynUser, ASYN_TRACE_ERROR,
+                  "%s:writeInt32 camera has no TriggerSoftware command\n", driverName);
+            status = asynError;
+        } else if (value) {
+            this->triggerRequests++;
+            epicsEventSignal(this->triggerEvent);
+        }
+    } else if (function == AravisTriggerReset) {
+        this->resetTriggerStatistics();
+    } else if (function == AravisReplay) {
+        /* The replay thread uses the stream buffers, so it cannot run with the camera */
+        int acquire;
+        getIntegerParam(ADAcquire, &acquire);
+        if (value && acquire) {
+            asynPrint(pasynUser, ASYN_TRACE_ERROR,
+                  "%s:writeInt32 cannot replay while acquiring\n", driverName);
+            status = asynError;
+        } else if (value && !this->replaying) {
+            this->replaying = true;
+            status = setIntegerParam(function, 1);
+            epicsEventSignal(this->replayEvent);
+        } else if (!value) {
+            /* The replay thread clears the parameter when it has stopped */
+            this->replaying = false;
+            epicsEventSignal(this->replayEvent);
+        }
+    } else if (function == AravisReplayMode) {
+        if ((value >= AravisReplayOriginal) && (value <= AravisReplayMax))
+            status = setIntegerParam(function, value);
+        else
+            status = asynError;
+    } else if (function == AravisLiveAddress) {
+        /* The live view is delivered on one of the addresses the port was made with */
+        if ((value >= 0) && (value < this->maxAddr))
+            status = setIntegerParam(function, value);
+        else
+            status = asynError;
+    } else if (function == AravisLiveReconfig) {
+        status = setIntegerParam(function, value ? 1 : 0);
+    } else if (function == AravisRecord) {
+        /* The next acquisition opens a recording, turning it off ends the current one */
+        if (!value) this->closeRecording();
+        status = setIntegerParam(function, value ? 1 : 0);
+    } else if (function == AravisShm) {
+        /* Readers see the segment become invalid. It is made by the next acquisition */
+        if (value == AravisShmOff) this->shmRing.close();
+        status = setIntegerParam(function, value);
+    } else if (function == AravisMinBuffers) {
+        if (value >= 0)
+            status = setIntegerParam(function, value);
+        else
+            status = asynError;
+    } else if (function == AravisBackPressure) {
+        /* Turning it off forgets the buffers owed, the streams keep the ones they have */
+        if (!value) {
+            for (auto pStream : this->streams) {
+                pStream->deficit = 0;
+            }
+            this->updateThrottle();
+        }
+        status = setIntegerParam(function, value ? 1 : 0);
+    } else if (function == AravisStatsFullScale) {
+        if (value >= 0)
+            status = setIntegerParam(function, value);
+        else
+            status = asynError;
+    } else if (function == AravisStatsHistSize) {
+        if ((value >= 0) && (value <= MAX_HIST_SIZE))
+            status = setIntegerParam(function, value);
+        else
+            status = asynError;
+    } else if (function == AravisShmSlots) {
+        if (value > 0)
+            status = setIntegerParam(function, value);
+        else
+            status = asynError;
+    } else if (function == AravisRecordBuffer) {
+        if (value > 0)
+            status = setIntegerParam(function, value);
+        else
+            status = asynError;
+    } else if (this->isImageFormatParam(function) && this->liveReconfigActive()) {
+        /* These change the payload, and most cameras lock them while acquiring */
+        status = this->reconfigureLive(pasynUser, value, 0., false);
+    } else if (function == AravisBulkApply) {
+        /* Going back to direct writes applies the collected ones */
+        if (!value) status = this->applyBulkWrites();
+        setIntegerParam(function, value ? 1 : 0);
+    } else if (this->queueBulkWrite(function, value, 0., false)) {
+        /* Done by the next bulk apply */
+    } else if (this->queueFeatureWrite(function, value, 0., false)) {
+        /* Done later by the write thread */
+    } else if (function == AravisEvents) {
+        status = this->enableEvents(value);
+        if (status == asynSuccess) setIntegerParam(function, value);
+    } else if (function == AravisLiveDecimate) {
+        if (value >= 0)
+            status = setIntegerParam(function, value);
+        else
+            status = asynError;
+    } else if (function == AravisSWDecimate) {
+        if (value >= 1)
+            status = setIntegerParam(function, value);
+        else
+            status = asynError;
+    } else if (function == AravisSWBinMode || function == AravisSWMinX || function == AravisSWMinY ||
+               function == AravisSWSizeX || function == AravisSWSizeY) {
+        if (value >= 0)
+            status = setIntegerParam(function, value);
+        else
+            status = asynError;
+    } else if (function == NDPoolEmptyFreeList) {
+        /* The frames come from arrayPool, the base class empties the pool it made */
+        this->arrayPool->emptyFreeList();
+        status = ADGenICam::writeInt32(pasynUser, value);
+    } else if ((function < FIRST_ARAVIS_CAMERA_PARAM) || (function > LAST_ARAVIS_CAMERA_PARAM)) {
+        /* If this parameter belongs to a base class call its method */
+        /* GenICam parameters are created after this constructor runs, so they are higher numbers */
+        status = ADGenICam::writeInt32(pasynUser, value);
+    /* generic feature lookup */
     } else {
         status = asynError;
     }
@@ -618,6 +2202,107 @@ asynStatus ADAravis::writeInt32(asynUser *pasynUser, epicsInt32 value)
     return status;
 }
 
+/** Called when asyn clients call pasynFloat64->write().
+  * \param[in] pasynUser pasynUser structure that encodes the reason and address.
+  * \param[in] value Value to write. */
+asynStatus ADAravis::writeFloat64(asynUser *pasynUser, epicsFloat64 value)
+{
+    int function = pasynUser->reason;
+    asynStatus status = asynSuccess;
+
+    if (function == AravisStatusRate || function == AravisLiveMaxRate || function == AravisRingMemory ||
+        function == AravisThrottle) {
+        /* 0 publishes the statistics with every frame, or removes the live view rate limit */
+        if ((value >= 0) && ((function != AravisThrottle) || (value < 1))) {
+            status = setDoubleParam(function, value);
+            if (function == AravisStatusRate) epicsEventSignal(this->statusEvent);
+        } else {
+            status = asynError;
+        }
+        callParamCallbacks();
+        if (status)
+            asynPrint(pasynUser, ASYN_TRACE_ERROR,
+                  "%s:writeFloat64 error, status=%d function=%d, value=%f\n",
+                  driverName, status, function, value);
+        return status;
+    }
+    if (function == AravisLUTGamma) {
+        if (value > 0) {
+            status = setDoubleParam(function, value);
+            this->buildLUT();
+        } else {
+            status = asynError;
+        }
+        callParamCallbacks();
+        return status;
+    }
+    if (function == AravisTriggerHistBin) {
+        /* A new bin width starts a new histogram */
+        if (value > 0) {
+            this->triggerLock.lock();
+            this->triggerHistBin = value;
+            this->triggerLock.unlock();
+            status = setDoubleParam(function, value);
+            this->resetTriggerStatistics();
+        } else {
+            status = asynError;
+        }
+        callParamCallbacks();
+        return status;
+    }
+    if (this->isImageFormatParam(function) && this->liveReconfigActive()) {
+        /* Some cameras have float binning or decimation features */
+        status = this->reconfigureLive(pasynUser, 0, value, true);
+        callParamCallbacks();
+        return status;
+    }
+    if (this->queueBulkWrite(function, 0, value, true) ||
+        this->queueFeatureWrite(function, 0, value, true)) {
+        callParamCallbacks();
+        return asynSuccess;
+    }
+    return ADGenICam::writeFloat64(pasynUser, value);
+}
+
+/** Called when asyn clients call pasynInt32->read().
+  * The base class reports the pool it made, so the pool readbacks are done here from arrayPool.
+  * \param[in] pasynUser pasynUser structure that encodes the reason and address.
+  * \param[out] value Value read. */
+asynStatus ADAravis::readInt32(asynUser *pasynUser, epicsInt32 *value)
+{
+    int function = pasynUser->reason;
+
+    if (function == NDPoolAllocBuffers) {
+        *value = this->arrayPool->getNumBuffers();
+    } else if (function == NDPoolFreeBuffers) {
+        *value = this->arrayPool->getNumFree();
+    } else {
+        return ADGenICam::readInt32(pasynUser, value);
+    }
+    setIntegerParam(function, *value);
+    return asynSuccess;
+}
+
+/** Called when asyn clients call pasynFloat64->read().
+  * The base class reports the pool it made, so the pool readbacks are done here from arrayPool.
+  * \param[in] pasynUser pasynUser structure that encodes the reason and address.
+  * \param[out] value Value read. */
+asynStatus ADAravis::readFloat64(asynUser *pasynUser, epicsFloat64 *value)
+{
+    int function = pasynUser->reason;
+
+    /* In MiB, as asynNDArrayDriver reports them */
+    if (function == NDPoolMaxMemory) {
+        *value = this->arrayPool->getMaxMemory() / 1048576.;
+    } else if (function == NDPoolUsedMemory) {
+        *value = this->arrayPool->getMemorySize() / 1048576.;
+    } else {
+        return ADGenICam::readFloat64(pasynUser, value);
+    }
+    setDoubleParam(function, *value);
+    return asynSuccess;
+}
+
 /** Report status of the driver.
   * Prints details about the driver if details>0.
   * It then calls the ADDriver::report() method.
@@ -635,6 +2320,37 @@ void ADAravis::report(FILE *fp, int details)
         getIntegerParam(NDDataType, &dataType);
         fprintf(fp, "  NX, NY:            %d  %d\n", nx, ny);
         fprintf(fp, "  Data type:         %d\n", dataType);
+        fprintf(fp, "  Streams:           %d\n", (int)this->streams.size());
+        int liveDecimate;
+        double liveMaxRate;
+        getIntegerParam(AravisLiveDecimate, &liveDecimate);
+        getDoubleParam(AravisLiveMaxRate, &liveMaxRate);
+        if (liveDecimate > 0)
+            fprintf(fp, "  Live view:         NDArray address %d, every %d frames, max %.1f Hz\n",
+                    (int)this->streams.size(), liveDecimate, liveMaxRate);
+        fprintf(fp, "  NDArray pool:      %.1f of %.1f MB, %d of %d arrays free\n",
+                this->pNDArrayPool->getMemorySize() / 1.e6, this->pNDArrayPool->getMaxMemory() / 1.e6,
+                this->pNDArrayPool->getNumFree(), this->pNDArrayPool->getNumBuffers());
+        for (auto pStream : this->streams) {
+            gint nInput = 0, nOutput = 0;
+            if (pStream->stream) arv_stream_get_n_buffers(pStream->stream, &nInput, &nOutput);
+            fprintf(fp, "    Stream %d: NDArray address %d, payload %d, frames %d, queued %d\n",
+                    pStream->index, pStream->index, pStream->payload, pStream->arrayCounter,
+                    epicsMessageQueuePending(pStream->msgQId));
+            fprintf(fp, "      buffers waiting for data %d, filled %d, allocation failures %d\n",
+                    nInput, nOutput, (int)pStream->allocFailures);
+            fprintf(fp, "      queue high water %d, dropped newest %d, dropped oldest %d, blocked %d\n",
+                    (int)pStream->highWater, (int)pStream->droppedNewest, (int)pStream->droppedOldest,
+                    (int)pStream->blocked);
+        }
+        fprintf(fp, "  Connect time:      %.2f s\n", this->connectTime);
+        this->triggerLock.lock();
+        fprintf(fp, "  Software triggers: %d sent, %d missed, latency mean %.3f max %.3f ms\n",
+                this->triggerCount, this->triggerMissed,
+                this->triggerLatencies ? this->triggerLatencySum / this->triggerLatencies : 0,
+                this->triggerLatencyMax);
+        this->triggerLock.unlock();
+        arvDiscovery::instance()->report(fp);
     }
     /* Invoke the base class method */
     ADGenICam::report(fp, details);
@@ -643,40 +2359,119 @@ void ADAravis::report(FILE *fp, int details)
 
 /** Allocate an NDArray and prepare a buffer that is passed to the stream
     this->camera exists, lock taken */
-asynStatus ADAravis::allocBuffer() {
+asynStatus ADAravis::allocBuffer(aravisStream *pStream, bool retry) {
     const char *functionName = "allocBuffer";
     ArvBuffer *buffer;
     NDArray *pRaw;
     size_t bufferDims[2] = {1,1};
 
     /* check stream exists */
-    if (this->stream == NULL) {
+    if (pStream->stream == NULL) {
         asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
                     "%s:%s: Cannot allocate buffer on a NULL stream\n",
                     driverName, functionName);
         return asynError;
     }
 
-    pRaw = this->pNDArrayPool->alloc(2, bufferDims, NDInt8, this->payload, NULL);
+    pRaw = this->pNDArrayPool->alloc(2, bufferDims, NDInt8, pStream->payload, NULL);
     if (pRaw==NULL) {
+        /* Retries for a buffer the stream is already short of are not reported again */
+        if (retry) return asynError;
+        pStream->allocFailures++;
         asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
                     "%s:%s: error allocating raw buffer\n",
                     driverName, functionName);
         return asynError;
     }
 
-    buffer = arv_buffer_new_full(this->payload, pRaw->pData, (void *)pRaw, destroyBuffer);
-    arv_stream_push_buffer (this->stream, buffer);
+    this->prepareArray(pRaw);
+    buffer = arv_buffer_new_full(pStream->payload, pRaw->pData, (void *)pRaw, destroyBuffer);
+    g_object_set_data(G_OBJECT(buffer), GENERATION_KEY, GINT_TO_POINTER(pStream->generation));
+    arv_stream_push_buffer (pStream->stream, buffer);
     return asynSuccess;
 }
 
+/** Give the stream n new buffers. With ARAVIS_BACK_PRESSURE the buffers that cannot be made because the
+    pool is full are remembered and made by a later call, otherwise the stream has fewer buffers. Lock taken */
+void ADAravis::refillBuffers(aravisStream *pStream, int n) {
+    int backPressure;
+
+    getIntegerParam(AravisBackPressure, &backPressure);
+    for (int i=0; i<n; i++) {
+        if ((this->allocBuffer(pStream) != asynSuccess) && backPressure) pStream->deficit++;
+    }
+    while ((pStream->deficit > 0) && (this->allocBuffer(pStream, true) == asynSuccess)) {
+        pStream->deficit--;
+    }
+    if (!backPressure) pStream->deficit = 0;
+    this->updateThrottle();
+}
+
+/** Whether a frame must go straight back to the stream instead of to the plugins, because the stream
+    is short of buffers and is down to ARAVIS_MIN_BUFFERS waiting for data. Lock taken */
+bool ADAravis::holdReserve(aravisStream *pStream) {
+    int minBuffers;
+    gint nInput, nOutput;
+
+    if ((pStream->deficit == 0) || (pStream->stream == NULL)) return false;
+    getIntegerParam(AravisMinBuffers, &minBuffers);
+    arv_stream_get_n_buffers(pStream->stream, &nInput, &nOutput);
+    return nInput < minBuffers;
+}
+
+/** Reduce the camera frame rate by ARAVIS_THROTTLE while any stream is short of buffers, or with the Block
+    overflow policy has a full queue, and put it back when they have all caught up. Lock taken */
+void ADAravis::updateThrottle() {
+    double throttle;
+    bool starved = false;
+    GErrorHelper err;
+    const char *functionName = "updateThrottle";
+
+    for (auto pStream : this->streams) {
+        if (pStream->deficit > 0) starved = true;
+        if ((this->overflowPolicy == AravisOverflowBlock) &&
+            (epicsMessageQueuePending(pStream->msgQId) >= this->queueSize)) starved = true;
+    }
+    getDoubleParam(AravisThrottle, &throttle);
+    if (starved && !this->throttled && (throttle > 0) && (throttle < 1) && this->camera) {
+        this->throttleRate = arv_camera_get_frame_rate(this->camera, err.get());
+        if (this->throttleRate <= 0) return;
+        arv_camera_set_frame_rate(this->camera, this->throttleRate * throttle, err.get());
+        this->throttled = true;
+        asynPrint(this->pasynUserSelf, ASYN_TRACE_WARNING,
+                    "%s:%s: frames are waiting, frame rate reduced from %g to %g Hz\n",
+                    driverName, functionName, this->throttleRate, this->throttleRate * throttle);
+    } else if (!starved && this->throttled) {
+        if (this->camera) arv_camera_set_frame_rate(this->camera, this->throttleRate, err.get());
+        this->throttled = false;
+        asynPrint(this->pasynUserSelf, ASYN_TRACE_WARNING,
+                    "%s:%s: frame rate restored to %g Hz\n", driverName, functionName, this->throttleRate);
+    }
+    setIntegerParam(AravisThrottled, this->throttled ? 1 : 0);
+}
+
+/** CPU time in seconds used by the aravis threads that receive the streams, as far as they are known */
+double ADAravis::receiveCpuTime() {
+    double cpuTime = 0;
+
+    for (auto pStream : this->streams) {
+        if (pStream->receiveTid != 0) cpuTime += threadCpuTime(pStream->receiveTid);
+    }
+    return cpuTime;
+}
+
+/** Process stream 0 in the polling thread */
+void ADAravis::run() {
+    this->streamTask(this->streams[0]);
+}
+
 /** Check what event we have, and deal with new frames.
     this->camera exists, lock not taken */
-void ADAravis::run() {
-    epicsTimeStamp lastFeatureGet;
-    int numImagesCounter, imageMode, numImages, acquire;
-    const char *functionName = "run";
+void ADAravis::streamTask(aravisStream *pStream) {
+    int numImagesCounter, imageMode, numImages, acquire, recordOnly = 0, shmMode;
+    const char *functionName = "streamTask";
     ArvBuffer *buffer;
+    struct raw_frame frame;
 
     /* Wait for database to be up */
     while (!iocRunning) {
@@ -684,34 +2479,104 @@ void ADAravis::run() {
     }
 
     /* Loop forever */
-    epicsTimeGetCurrent(&lastFeatureGet);
     while (1) {
         /* Wait 5ms for an array to arrive from the queue */
-        if (epicsMessageQueueReceiveWithTimeout(this->msgQId, &buffer, sizeof(&buffer), 0.005) == -1) {
+        if (epicsMessageQueueReceiveWithTimeout(pStream->msgQId, &buffer, sizeof(&buffer), 0.005) == -1) {
+            /* The ring has been triggered and there are no new frames, e.g. because acquisition has stopped */
+            if ((pStream->index == 0) && this->ringFlushPending) {
+                this->lock();
+                this->ringFlush(pStream);
+                callParamCallbacks();
+                this->unlock();
+            }
+            /* The queue has drained, so put back a frame rate reduced by the Block policy */
+            if (this->throttled) {
+                this->lock();
+                this->updateThrottle();
+                this->unlock();
+            }
+            /* Make the buffers the stream is short of, if the plugins have released some arrays */
+            if (pStream->deficit > 0) {
+                this->lock();
+                if (pStream->deficit > 0) this->refillBuffers(pStream, 0);
+                this->unlock();
+            }
+            /* The frames no longer fit, e.g. the ROI was changed by another client. The status thread
+             * resizes the buffers, as that replaces the streams this thread takes frames from */
+            if (pStream->sizeMismatch) {
+                this->lock();
+                pStream->sizeMismatch = false;
+                if (this->liveReconfigActive()) {
+                    asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW,
+                          "%s:%s: stream %d frame size changed, resizing buffers\n",
+                          driverName, functionName, pStream->index);
+                    this->reconfigPending = true;
+                    epicsEventSignal(this->statusEvent);
+                }
+                this->unlock();
+            }
         } else {
             /* Got a buffer, so lock up and process it */
+            describeBuffer(buffer, pStream->index, &frame);
             this->lock();
+            /* The frames held in the ring come before this one */
+            if ((pStream->index == 0) && this->ringFlushPending) {
+                this->ringFlush(pStream);
+            }
             getIntegerParam(ADAcquire, &acquire);
-            if (acquire) {
-                this->processBuffer(buffer);
+            /* The recorder and the raw shared memory get every frame as it arrived.
+             * They copy the frame, so do that without the lock */
+            getIntegerParam(AravisShm, &shmMode);
+            if (acquire && (this->recording || (shmMode == AravisShmRaw))) {
+                bool record = this->recording;
+                this->unlock();
+                if (record) this->recorder.addFrame(buffer, pStream->index);
+                if (shmMode == AravisShmRaw) this->publishShm(pStream, &frame, NULL, NULL);
+                this->lock();
+                getIntegerParam(ADAcquire, &acquire);
+                getIntegerParam(AravisRecordOnly, &recordOnly);
+            }
+            if (acquire && this->ringHold(pStream, buffer)) {
+                /* Kept in the ring until it is triggered */
+            } else if (acquire && this->holdReserve(pStream)) {
+                /* The plugins hold the pool, so drop the frame rather than let the stream run out of buffers */
+                if (currentBuffer(pStream, buffer)) arv_stream_push_buffer(pStream->stream, buffer);
+                else g_object_unref(buffer);
+                pStream->reserveDrops++;
+                this->refillBuffers(pStream, 0);
+            } else if (acquire) {
+                /* The stream only gets a buffer in place of one of its own */
+                bool refill = currentBuffer(pStream, buffer);
+                if (this->recording && recordOnly) {
+                    /* Only on disk, so skip the conversion and the plugins */
+                    this->countFrame(pStream);
+                } else {
+                    this->processBuffer(pStream, &frame);
+                }
                 /* free memory */
                 g_object_unref(buffer);
-                /* See if acquisition is done */
+                /* processBuffer releases the lock while converting, so check we are still acquiring */
+                getIntegerParam(ADAcquire, &acquire);
+                /* See if acquisition is done, stream 0 decides this */
                 getIntegerParam(ADNumImages, &numImages);
                 getIntegerParam(ADNumImagesCounter, &numImagesCounter);
                 getIntegerParam(ADImageMode, &imageMode);
-                if ((imageMode == ADImageSingle) ||
-                    ((imageMode == ADImageMultiple) &&
-                     (numImagesCounter >= numImages))) {
+                if (!acquire) {
+                } else if ((pStream->index == 0) &&
+                    ((imageMode == ADImageSingle) ||
+                     ((imageMode == ADImageMultiple) &&
+                      (numImagesCounter >= numImages)))) {
                     this->stopCapture();
                     // Want to make sure we're idle before we callback on ADAcquire
+                    this->updateStatistics();
                     callParamCallbacks();
                     setIntegerParam(ADAcquire, 0);
+                    callParamCallbacks();
                     asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW,
                           "%s:%s: acquisition completed\n", driverName, functionName);
-                } else {
+                } else if (refill) {
                     /* Allocate the new raw buffer we use to compute images. */
-                    this->allocBuffer();
+                    this->refillBuffers(pStream, 1);
                 }
             } else {
                 // We recieved a buffer that we didn't request
@@ -722,41 +2587,59 @@ void ADAravis::run() {
     }
 }
 
-asynStatus ADAravis::processBuffer(ArvBuffer *buffer) {
-    int arrayCallbacks, imageCounter, numImages, numImagesCounter, imageMode;
-    int colorMode, dataType, bayerFormat;
+/** The pixel format descriptor and converter for a frame of a stream. They are only looked up again
+    when the pixel format or the settings differ from the last frame. Returns NULL for an unknown pixel format */
+const struct frame_converter *ADAravis::getConverter(aravisStream *pStream, int pixel_format,
+                                                     const struct frame_info *info) {
+    const char *functionName = "getConverter";
+    struct frame_converter *pConv = &pStream->converter;
+
+    if ((pConv->pFormat != NULL) && (pConv->pixelFormat == pixel_format) && (pConv->shiftDir == info->shiftDir) &&
+        (pConv->leftShift == info->leftShift) && (pConv->stats == info->stats.enabled) &&
+        (pConv->lutMode == info->lutMode)) {
+        return pConv;
+    }
+    pConv->pFormat = NULL;
+    const int N = sizeof(pix_lookup) / sizeof(struct pix_lookup);
+    for (int i = 0; i < N; i ++) {
+        if (pix_lookup[i].fmt == (ArvPixelFormat) pixel_format) {
+            pConv->pFormat = &pix_lookup[i];
+            break;
+        }
+    }
+    if (pConv->pFormat == NULL) {
+        asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+                    "%s:%s: Could not find a match for pixel format: %d\n",
+                    driverName, functionName, pixel_format);
+        return NULL;
+    }
+    pConv->pixelFormat = pixel_format;
+    pConv->shiftDir = info->shiftDir;
+    pConv->leftShift = info->leftShift;
+    pConv->stats = info->stats.enabled;
+    pConv->lutMode = info->lutMode;
+    pConv->convert = selectConverter(pConv->pFormat->unpack, info->leftShift, info->shiftDir,
+                                     pConv->pFormat->dataType, info->stats.enabled, info->lutMode);
+    asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW,
+                "%s:%s: stream %d pixel format 0x%x, unpack %d, shift %d, stats %d, LUT %d\n",
+                driverName, functionName, pStream->index, pixel_format, pConv->pFormat->unpack,
+                info->shiftDir, info->stats.enabled, info->lutMode);
+    return pConv;
+}
+
+/** Convert a frame into an NDArray, unpacking, shifting and reducing it as requested.
+    Called without the lock, so only uses the settings in info and the scratch buffers of pStream */
+asynStatus ADAravis::convertBuffer(aravisStream *pStream, const struct raw_frame *pFrame, struct frame_info *info) {
     size_t expected_size;
-    int xDim=0, yDim=1, binX, binY, shiftDir, shiftBits;
-    double acquirePeriod;
-    const char *functionName = "processBuffer";
-    guint64 n_completed_buffers, n_failures, n_underruns;
+    int xDim=0, yDim=1;
+    const char *functionName = "convertBuffer";
     NDArray *pRaw;
-    bool releaseArray = false;
 
-    /* Get the current parameters */
-    getIntegerParam(NDArrayCounter, &imageCounter);
-    getIntegerParam(ADNumImages, &numImages);
-    getIntegerParam(ADNumImagesCounter, &numImagesCounter);
-    getIntegerParam(ADImageMode, &imageMode);
-    getIntegerParam(NDArrayCallbacks, &arrayCallbacks);
-    getDoubleParam(ADAcquirePeriod, &acquirePeriod);
-    getIntegerParam(AravisShiftDir, &shiftDir); 
-    getIntegerParam(AravisShiftBits, &shiftBits); 
-    /* The buffer structure does not contain the binning, get that from param lib,
-     * but it could be wrong for this frame if recently changed */
-    getIntegerParam(ADBinX, &binX);
-    getIntegerParam(ADBinY, &binY);
-    /* Report a new frame with the counters */
-    imageCounter++;
-    numImagesCounter++;
-    setIntegerParam(NDArrayCounter, imageCounter);
-    setIntegerParam(ADNumImagesCounter, numImagesCounter);
-    if (imageMode == ADImageMultiple) {
-        setDoubleParam(ADTimeRemaining, (numImages - numImagesCounter) * acquirePeriod);
-    }
-    /* find the buffer */
+    info->pArray = NULL;
+    info->releaseArray = false;
 
-    pRaw = (NDArray *) arv_buffer_get_user_data(buffer);
+    /* find the buffer */
+    pRaw = pFrame->pRaw;
     if (pRaw == NULL) {
         asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
                 "%s:%s: where did this buffer come from?\n",
@@ -764,66 +2647,85 @@ asynStatus ADAravis::processBuffer(ArvBuffer *buffer) {
         return asynError;
     }
 //  printf("callb buffer: %p, pRaw[%d]: %p, pData %p\n", buffer, i, pRaw, pRaw->pData);
-    int pixel_format = arv_buffer_get_image_pixel_format(buffer);
-    int width = arv_buffer_get_image_width(buffer);
-    int height = arv_buffer_get_image_height(buffer);
-    int x_offset = arv_buffer_get_image_x(buffer);
-    int y_offset = arv_buffer_get_image_y(buffer);
-    size_t size = 0;
-    arv_buffer_get_data(buffer, &size);
+    int pixel_format = pFrame->meta.pixelFormat;
+    int width = pFrame->meta.width;
+    int height = pFrame->meta.height;
+    info->xOffset = pFrame->meta.xOffset;
+    info->yOffset = pFrame->meta.yOffset;
+    size_t size = pFrame->meta.size;
     
     //  Print the first 16 bytes of the buffer in hex
     //for (int i=0; i<16; i++) printf("%x ", ((epicsUInt8 *)pRaw->pData)[i]); printf("\n");
 
-    // If the pixel format is Mono12p or Mono12Packed we need to do the conversion to UInt16 here
-    if ((pixel_format == ARV_PIXEL_FORMAT_MONO_12_P) || 
-       ( pixel_format == ARV_PIXEL_FORMAT_MONO_12_PACKED)) {
-        //epicsTimeStamp tstart, tend;
-        //epicsTimeGetCurrent(&tstart);
-        int convertFormat;
-        getIntegerParam(AravisConvertPixelFormat, &convertFormat);
-        bool leftShift = (convertFormat == AravisConvertPixelFormatMono16High);
-        NDArray *pIn = pRaw;
-        size_t bufferDims[2] = {(size_t)width, (size_t)height};
-        pRaw = this->pNDArrayPool->alloc(2, bufferDims, NDUInt16, 0, NULL);
-        if (pixel_format == ARV_PIXEL_FORMAT_MONO_12_P) {
-            decompressMono12p(width*height, leftShift, (epicsUInt8 *)pIn->pData, (epicsUInt16 *)pRaw->pData);
-        } else {
-            decompressMono12Packed(width*height, leftShift, (epicsUInt8 *)pIn->pData, (epicsUInt16 *)pRaw->pData);
+    const struct frame_converter *pConv = this->getConverter(pStream, pixel_format, info);
+    if (pConv == NULL) return asynError;
+    info->colorMode   = pConv->pFormat->colorMode;
+    info->dataType    = pConv->pFormat->dataType;
+    info->bayerFormat = pConv->pFormat->bayerFormat;
+    convert_func convert = pConv->convert;
+    /* The data the converter reads when it writes to a new array, and the array it was in */
+    const void *pIn = NULL;
+    NDArray *pSource = NULL;
+    bool newArray = false;
+
+    if ((info->colorMode == NDColorModeMono) && info->reduceEnabled) {
+        // Crop, bin and decimate in the same pass as the unpack and shift, so we only ever write the smaller array
+        NDArray *pOut = this->reduceMonoFrame(pStream, pRaw, size, pixel_format, width, height, 
+                                              info->leftShift, info->shiftDir, info->shiftBits, &info->reduce);
+        if (pOut == NULL) return asynError;
+        pRaw = pOut;
+        info->xOffset += info->reduce.minX * info->binX;
+        info->yOffset += info->reduce.minY * info->binY;
+        info->binX *= info->reduce.bin * info->reduce.decimate;
+        info->binY *= info->reduce.bin * info->reduce.decimate;
+        width = (int)pRaw->dims[0].size;
+        height = (int)pRaw->dims[1].size;
+        info->dataType = pRaw->dataType;
+        size = width * height * (info->dataType == NDUInt32 ? 4 : info->dataType == NDUInt16 ? 2 : 1);
+        info->releaseArray = true;
+        /* A reduced frame was already unpacked and shifted */
+        convert = selectConverter(AravisUnpackNone, false, AravisShiftNone, info->dataType, info->stats.enabled,
+                                  info->lutMode);
+        if ((info->lutMode != AravisLUTOff) && (info->dataType == NDUInt16)) {
+            pIn = pRaw->pData;
+            pSource = pRaw;
+            newArray = true;
+        }
+    } else if ((pConv->pFormat->unpack != AravisUnpackNone) ||
+               ((info->lutMode != AravisLUTOff) && (info->dataType == NDUInt16))) {
+        // If the pixel format is Mono12p or Mono12Packed we need to do the conversion to UInt16 here,
+        // and to UInt8 with the LUT. It is done below, together with the shift and the statistics
+        pIn = pRaw->pData;
+        newArray = true;
+    }
+    if (newArray) {
+        NDDataType_t outType = (info->lutMode != AravisLUTOff) ? NDUInt8 : NDUInt16;
+        size_t numValues = (size_t)width * height * (info->colorMode == NDColorModeRGB1 ? 3 : 1);
+        size_t bufferDims[2] = {numValues / height, (size_t)height};
+        pRaw = this->pNDArrayPool->alloc(2, bufferDims, outType, 0, NULL);
+        if (pRaw == NULL) {
+            asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+                        "%s:%s: error allocating %s array\n",
+                        driverName, functionName, outType == NDUInt8 ? "8 bit" : "unpacked");
+            if (pSource) pSource->release();
+            return asynError;
         }
-        //epicsTimeGetCurrent(&tend);
-        //printf("Time to convert Mono12 = %f\n", epicsTimeDiffInSeconds(&tend, &tstart));
-        size = width * height * sizeof(epicsUInt16);
-        releaseArray = true;
+        this->prepareArray(pRaw);
+        info->dataType = outType;
+        size = numValues * (outType == NDUInt8 ? 1 : 2);
+        info->releaseArray = true;
     }
     //  Print the first 8 pixels of the buffer in decimal
     //for (int i=0; i<8; i++) printf("%u ", ((epicsUInt16 *)pRaw->pData)[i]); printf("\n");
 
-    /* Put the frame number and time stamp into the buffer */
-    pRaw->uniqueId = imageCounter;
-    pRaw->timeStamp = arv_buffer_get_timestamp(buffer) / 1.e9;
-
-    /* Update the areaDetector timeStamp */
-    updateTimeStamp(&pRaw->epicsTS);
-
-    /* Get any attributes that have been defined for this driver */
-    this->getAttributes(pRaw->pAttributeList);
+    info->pArray = pRaw;
+    info->width = width;
+    info->height = height;
+    info->size = size;
 
     /* Annotate it with its dimensions */
-    if (this->lookupColorMode(pixel_format, &colorMode, &dataType, &bayerFormat) != asynSuccess) {
-        asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
-                    "%s:%s: unknown pixel format %d\n",
-                    driverName, functionName, pixel_format);
-        return asynError;
-    }
-    pRaw->pAttributeList->add("BayerPattern", "Bayer Pattern", NDAttrInt32, &bayerFormat);
-    pRaw->pAttributeList->add("ColorMode", "Color Mode", NDAttrInt32, &colorMode);
-    pRaw->dataType = (NDDataType_t) dataType;
-    setIntegerParam(NDArraySizeX, width);
-    setIntegerParam(NDArraySizeY, height);
-    setIntegerParam(NDArraySize, (int)size);
-    setIntegerParam(NDDataType,dataType);
-    switch (colorMode) {
+    pRaw->dataType = (NDDataType_t) info->dataType;
+    switch (info->colorMode) {
         case NDColorModeMono:
         case NDColorModeBayer:
             xDim = 0;
@@ -843,30 +2745,30 @@ asynStatus ADAravis::processBuffer(ArvBuffer *buffer) {
         default:
             asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
                         "%s:%s: unknown colorMode %d\n",
-                        driverName, functionName, colorMode);
+                        driverName, functionName, info->colorMode);
             return asynError;
     }
     pRaw->dims[xDim].size    = width;
-    pRaw->dims[xDim].offset  = x_offset;
-    pRaw->dims[xDim].binning = binX;
+    pRaw->dims[xDim].offset  = info->xOffset;
+    pRaw->dims[xDim].binning = info->binX;
     pRaw->dims[yDim].size    = height;
-    pRaw->dims[yDim].offset  = y_offset;
-    pRaw->dims[yDim].binning = binY;
-
-    /* If we are 16 bit, shift by the correct amount */
-    if (pRaw->dataType == NDUInt16) {
-        expected_size *= 2;
-        uint16_t *array = (uint16_t *) pRaw->pData;
-        if (shiftDir == AravisShiftLeft) {
-            for (unsigned int ib = 0; ib < size / 2; ib++) {
-                array[ib] = array[ib] << shiftBits;
-            }
-        } else if (shiftDir == AravisShiftRight) {
-            for (unsigned int ib = 0; ib < size / 2; ib++) {
-                array[ib] = array[ib] >> shiftBits;
-            }
+    pRaw->dims[yDim].offset  = info->yOffset;
+    pRaw->dims[yDim].binning = info->binY;
+
+    /* Unpack, shift and take the statistics with the converter chosen for this format and these settings.
+     * This is done a block at a time, so each block only goes through memory once */
+    int elementSize = (pRaw->dataType == NDUInt32) ? 4 : (pRaw->dataType == NDUInt16) ? 2 : 1;
+    expected_size *= elementSize;
+    if (info->stats.enabled) startStats(&info->stats, pRaw->dataType);
+    if (convert != NULL) {
+        size_t numValues = size / elementSize;
+        for (size_t first = 0; first < numValues; first += CONVERT_BLOCK) {
+            int n = (int) std::min((size_t) CONVERT_BLOCK, numValues - first);
+            convert(pIn, pRaw->pData, first, n, &info->args, &info->stats);
         }
     }
+    /* The reduced frame has been mapped to 8 bits */
+    if (pSource) pSource->release();
 
     if (expected_size != size) {
         asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
@@ -874,99 +2776,1426 @@ asynStatus ADAravis::processBuffer(ArvBuffer *buffer) {
                     driverName, functionName, width, height, size, expected_size);
         return asynError;
     }
+    return asynSuccess;
+}
+
+/** Count a new frame. Streams other than 0 have their own frame counter.
+    Returns the frame number. Lock taken */
+int ADAravis::countFrame(aravisStream *pStream) {
+    int imageCounter, numImages, numImagesCounter, imageMode;
+    double acquirePeriod;
+
+    pStream->arrayCounter++;
+    if (pStream->index != 0) {
+        if (pStream->index < this->maxAddr) setIntegerParam(pStream->index, NDArrayCounter, pStream->arrayCounter);
+        return pStream->arrayCounter;
+    }
+
+    getIntegerParam(NDArrayCounter, &imageCounter);
+    getIntegerParam(ADNumImages, &numImages);
+    getIntegerParam(ADNumImagesCounter, &numImagesCounter);
+    getIntegerParam(ADImageMode, &imageMode);
+    getDoubleParam(ADAcquirePeriod, &acquirePeriod);
+    imageCounter++;
+    numImagesCounter++;
+    setIntegerParam(NDArrayCounter, imageCounter);
+    setIntegerParam(ADNumImagesCounter, numImagesCounter);
+    if (imageMode == ADImageMultiple) {
+        setDoubleParam(ADTimeRemaining, (numImages - numImagesCounter) * acquirePeriod);
+    }
+    return imageCounter;
+}
+
+/** Convert a frame and do callbacks on it.
+    Lock taken, it is released while the frame is converted and while doing the NDArray callbacks */
+asynStatus ADAravis::processBuffer(aravisStream *pStream, const struct raw_frame *pFrame, const epicsTimeStamp *pTime) {
+    int arrayCallbacks, imageCounter;
+    int convertFormat;
+    const char *functionName = "processBuffer";
+    asynStatus status;
+    struct frame_info info;
+
+    /* Get the current parameters */
+    getIntegerParam(NDArrayCallbacks, &arrayCallbacks);
+    getIntegerParam(AravisShiftDir, &info.shiftDir); 
+    getIntegerParam(AravisShiftBits, &info.shiftBits); 
+    getIntegerParam(AravisConvertPixelFormat, &convertFormat);
+    info.leftShift = (convertFormat == AravisConvertPixelFormatMono16High);
+    info.reduceEnabled = this->getSoftwareReduce(&info.reduce);
+    int statsEnabled, fullScale;
+    getIntegerParam(AravisStats, &statsEnabled);
+    getIntegerParam(AravisStatsFullScale, &fullScale);
+    getIntegerParam(AravisStatsHistSize, &info.stats.histSize);
+    info.stats.enabled = (statsEnabled != 0);
+    info.stats.fullScale = fullScale;
+    getIntegerParam(AravisLUTMode, &info.lutMode);
+    info.args.shiftBits = info.shiftBits;
+    info.args.lutOffset = this->lutOffset;
+    info.args.lutScale = this->lutScale;
+    info.lut = this->lut;
+    info.args.lut = info.lut->data();
+    /* The buffer structure does not contain the binning, get that from param lib,
+     * but it could be wrong for this frame if recently changed */
+    getIntegerParam(ADBinX, &info.binX);
+    getIntegerParam(ADBinY, &info.binY);
+    /* Report a new frame with the counters */
+    imageCounter = this->countFrame(pStream);
+
+    /* Do the expensive part without the lock so streams and the port thread do not wait for each other */
+    this->unlock();
+    pStream->convertLock.lock();
+    status = this->convertBuffer(pStream, pFrame, &info);
+    pStream->convertLock.unlock();
+    this->lock();
+    if (status != asynSuccess) {
+        if (info.releaseArray) info.pArray->release();
+        return status;
+    }
+    NDArray *pRaw = info.pArray;
+
+    /* Put the frame number and time stamp into the buffer */
+    pRaw->uniqueId = imageCounter;
+    pRaw->timeStamp = pFrame->meta.timestamp / 1.e9;
+
+    /* Update the areaDetector timeStamp, frames from the ring have the time they arrived */
+    if (pTime)
+        pRaw->epicsTS = *pTime;
+    else
+        updateTimeStamp(&pRaw->epicsTS);
+
+    /* Get any attributes that have been defined for this driver */
+    this->getAttributes(pRaw->pAttributeList);
+
+    pRaw->pAttributeList->add("BayerPattern", "Bayer Pattern", NDAttrInt32, &info.bayerFormat);
+    pRaw->pAttributeList->add("ColorMode", "Color Mode", NDAttrInt32, &info.colorMode);
+    if (info.stats.enabled && info.stats.count) {
+        struct frame_stats &stats = info.stats;
+        double minValue = stats.min, maxValue = stats.max, sum = (double) stats.sum;
+        double mean = sum / stats.count, saturated = (double) stats.saturated;
+        pRaw->pAttributeList->add("StatsMin", "Minimum pixel value", NDAttrFloat64, &minValue);
+        pRaw->pAttributeList->add("StatsMax", "Maximum pixel value", NDAttrFloat64, &maxValue);
+        pRaw->pAttributeList->add("StatsMean", "Mean pixel value", NDAttrFloat64, &mean);
+        pRaw->pAttributeList->add("StatsSum", "Sum of the pixel values", NDAttrFloat64, &sum);
+        pRaw->pAttributeList->add("StatsSaturated", "Saturated pixels", NDAttrFloat64, &saturated);
+        if (pStream->index == 0) {
+            setDoubleParam(AravisStatsMin, minValue);
+            setDoubleParam(AravisStatsMax, maxValue);
+            setDoubleParam(AravisStatsMean, mean);
+            setDoubleParam(AravisStatsSum, sum);
+            setDoubleParam(AravisStatsSaturated, saturated);
+            this->statsHist.assign(stats.hist, stats.hist + stats.histSize);
+            this->statsHistNew = true;
+        }
+    }
+    /* Each stream has the size of its own frames on its address */
+    if (pStream->index < this->maxAddr) {
+        setIntegerParam(pStream->index, NDArraySizeX, info.width);
+        setIntegerParam(pStream->index, NDArraySizeY, info.height);
+        setIntegerParam(pStream->index, NDArraySize, (int)info.size);
+        setIntegerParam(pStream->index, NDDataType, info.dataType);
+    }
+
+    /* Local readers get the converted frame in shared memory */
+    int shmMode;
+    getIntegerParam(AravisShm, &shmMode);
+    if (shmMode == AravisShmConverted) {
+        this->unlock();
+        this->publishShm(pStream, pFrame, &info, &pRaw->epicsTS);
+        this->lock();
+    }
 
     /* this is a good image, so callback on it */
     if (arrayCallbacks) {
+        /* Stream 0 frames are also published, thinned out, on the live view address */
+        int liveAddress = -1;
+        if ((pStream->index == 0) && this->publishLive()) {
+            getIntegerParam(AravisLiveAddress, &liveAddress);
+        }
         /* Call the NDArray callback */
         asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW,
-             "%s:%s: calling imageData callback\n", driverName, functionName);
-        doCallbacksGenericPointer(pRaw, NDArrayData, 0);
+             "%s:%s: calling imageData callback for stream %d\n", driverName, functionName, pStream->index);
+        this->unlock();
+        if (pStream->index < this->maxAddr) doCallbacksGenericPointer(pRaw, NDArrayData, pStream->index);
+        /* The plugins take their own reference, so the same NDArray can be passed again without a copy */
+        if ((liveAddress >= 0) && (liveAddress < this->maxAddr)) {
+            doCallbacksGenericPointer(pRaw, NDArrayData, liveAddress);
+        }
+        this->lock();
     }
     
-    if (releaseArray) {
+    if (info.releaseArray) {
         pRaw->release();
     }
 
-    /* Report statistics */
-    if (this->stream != NULL) {
-        arv_stream_get_statistics(this->stream, &n_completed_buffers, &n_failures, &n_underruns);
-        setDoubleParam(AravisCompleted, (double) n_completed_buffers);
-        setDoubleParam(AravisFailures, (double) n_failures);
-        setDoubleParam(AravisUnderruns, (double) n_underruns);
-
-        if (ARV_IS_GV_DEVICE(this->stream)) {
-            guint64 n_resent_pkts, n_missing_pkts;
-            arv_gv_stream_get_statistics(ARV_GV_STREAM(this->stream), &n_resent_pkts, &n_missing_pkts);
-            setIntegerParam(AravisResentPkts,  (epicsInt32) n_resent_pkts);
-            setIntegerParam(AravisMissingPkts, (epicsInt32) n_missing_pkts);
-        }
+    /* The status thread publishes the statistics, unless it has been set to do so for every frame */
+    double statusRate;
+    getDoubleParam(AravisStatusRate, &statusRate);
+    if (statusRate <= 0) {
+        this->updateStatistics();
+        callParamCallbacks();
     }
-
-    /* Call the callbacks to update any changes */
-    callParamCallbacks();
     return asynSuccess;
 }
 
-asynStatus ADAravis::stopCapture() {
-    /* Stop the camera */
-    arv_camera_stop_acquisition(this->camera, NULL);
-    setIntegerParam(ADStatus, ADStatusIdle);
-    /* Tear down the old stream and make a new one */
-    return this->makeStreamObject();
-}
+/** Queue a write to an integer, float or boolean GenICam feature for the write thread if ARAVIS_ASYNC_WRITES is on.
+    A pending write to the same feature is replaced, so only the last value is written.
+    Returns false if the write must be done now. Lock taken */
+bool ADAravis::queueFeatureWrite(int function, epicsInt32 intValue, double doubleValue, bool isDouble) {
+    int asyncWrites, coalesced;
 
-asynStatus ADAravis::startCapture() {
-    int imageMode, numImages;
-    GErrorHelper err;
-    const char *functionName = "start";
-    
-    getIntegerParam(ADImageMode, &imageMode);
+    getIntegerParam(AravisAsyncWrites, &asyncWrites);
+    if (!asyncWrites || !this->connectionValid) return false;
+    /* Only the features themselves, not the ADDriver parameters mapped onto them */
+    if ((function >= FIRST_ARAVIS_CAMERA_PARAM) && (function <= LAST_ARAVIS_CAMERA_PARAM)) return false;
+    GenICamFeature *pFeature = mGCFeatureSet.getByIndex(function);
+    if (!pFeature) return false;
+    GCFeatureType_t featureType = pFeature->getFeatureType();
+    if ((featureType != GCFeatureTypeInteger) && (featureType != GCFeatureTypeDouble) &&
+        (featureType != GCFeatureTypeBoolean)) return false;
 
-    if (imageMode == ADImageSingle) {
-        arv_camera_set_acquisition_mode(this->camera, ARV_ACQUISITION_MODE_SINGLE_FRAME, err.get());
-    } else if (imageMode == ADImageMultiple) {
-        if (mGCFeatureSet.getByName("AcquisitionFrameCount")) {
-            getIntegerParam(ADNumImages, &numImages);
-            arv_device_set_integer_feature_value(this->device, "AcquisitionFrameCount", numImages, err.get());
-        }
-        arv_camera_set_acquisition_mode(this->camera, ARV_ACQUISITION_MODE_MULTI_FRAME, err.get());
+    struct feature_write write;
+    write.isDouble = isDouble;
+    write.intValue = intValue;
+    write.doubleValue = doubleValue;
+    epicsTimeGetCurrent(&write.queued);
+    auto it = this->pendingWrites.find(function);
+    if (it != this->pendingWrites.end()) {
+        /* Keep the time of the first write so the latency includes the time spent waiting */
+        write.queued = it->second.queued;
+        it->second = write;
+        getIntegerParam(AravisWritesCoalesced, &coalesced);
+        setIntegerParam(AravisWritesCoalesced, coalesced + 1);
     } else {
-        arv_camera_set_acquisition_mode(this->camera, ARV_ACQUISITION_MODE_CONTINUOUS, err.get());
+        this->pendingWrites[function] = write;
     }
-    setIntegerParam(ADNumImagesCounter, 0);
-    setIntegerParam(ADStatus, ADStatusAcquire);
+    /* Show the new value now, the readback after the write corrects it */
+    if (isDouble)
+        setDoubleParam(function, doubleValue);
+    else
+        setIntegerParam(function, intValue);
+    epicsEventSignal(this->writeEvent);
+    return true;
+}
 
-    /* fill the queue */
-    this->payload = arv_camera_get_payload(this->camera, err.get());
-    for (int i=0; i<NRAW; i++) {
-        if (this->allocBuffer() != asynSuccess) {
-            asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
-                        "%s:%s: allocBuffer returned error\n",
-                        driverName, functionName);
-            return asynError;
-        }
-    }
+/** Do one queued feature write through the ADGenICam write methods, which read it back.
+    Returns false if there was nothing to do. Lock taken */
+bool ADAravis::doFeatureWrite() {
+    const char *functionName = "doFeatureWrite";
+    asynStatus status;
+    epicsTimeStamp now;
+    int writesDone;
 
-    // Start the camera acquiring
-    arv_camera_start_acquisition (this->camera, err.get());
-    return asynSuccess;
+    if (this->pendingWrites.empty()) return false;
+    auto it = this->pendingWrites.begin();
+    int function = it->first;
+    struct feature_write write = it->second;
+    this->pendingWrites.erase(it);
+
+    this->pasynUserWrite->reason = function;
+    if (write.isDouble)
+        status = ADGenICam::writeFloat64(this->pasynUserWrite, write.doubleValue);
+    else
+        status = ADGenICam::writeInt32(this->pasynUserWrite, write.intValue);
+    if (status) {
+        const char *reasonName = "unknownReason";
+        getParamName(0, function, &reasonName);
+        asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+            "%s:%s: error writing %s, status=%d\n",
+            driverName, functionName, reasonName, status);
+    }
+    epicsTimeGetCurrent(&now);
+    setDoubleParam(AravisWriteLatency, epicsTimeDiffInSeconds(&now, &write.queued) * 1.e3);
+    getIntegerParam(AravisWritesDone, &writesDone);
+    setIntegerParam(AravisWritesDone, writesDone + 1);
+    callParamCallbacks();
+    return true;
 }
 
-/** Lookup a colorMode, dataType and bayerFormat from an ArvPixelFormat */
-asynStatus ADAravis::lookupColorMode(ArvPixelFormat fmt, int *colorMode, int *dataType, int *bayerFormat) {
-    const char *functionName = "lookupColorMode";
-    const int N = sizeof(pix_lookup) / sizeof(struct pix_lookup);
-    for (int i = 0; i < N; i ++)
-        if (pix_lookup[i].fmt == fmt) {
-            *colorMode   = pix_lookup[i].colorMode;
-            *dataType    = pix_lookup[i].dataType;
-            *bayerFormat = pix_lookup[i].bayerFormat;
-            return asynSuccess;
+/** Do the queued feature writes. The lock is released between writes
+    so other clients get a turn while a slider is being dragged */
+void ADAravis::writeTask() {
+    while (1) {
+        epicsEventWait(this->writeEvent);
+        while (1) {
+            this->lock();
+            bool done = !this->doFeatureWrite();
+            this->unlock();
+            if (done) break;
         }
-    asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
-                "%s:%s: Could not find a match for pixel format: %d\n",
-                driverName, functionName, fmt);
-    return asynError;
+    }
+}
+
+/** Collect a write to a GenICam feature for the next bulk apply if ARAVIS_BULK_APPLY is on.
+    Only the features loaded from the GenICam database are collected, the ADDriver parameters that are mapped onto
+    features (ADAcquireTime, ADSizeX, ...) have conversions and are written straight away.
+    Returns false if the write must be done now. Lock taken */
+bool ADAravis::queueBulkWrite(int function, epicsInt32 intValue, double doubleValue, bool isDouble) {
+    int bulkApply;
+
+    getIntegerParam(AravisBulkApply, &bulkApply);
+    if (!bulkApply || !this->connectionValid) return false;
+    /* GenICam database parameters are created after this constructor runs, so they are higher numbers */
+    if (function <= LAST_ARAVIS_CAMERA_PARAM) return false;
+    GenICamFeature *pFeature = mGCFeatureSet.getByIndex(function);
+    if (!pFeature || (pFeature->getFeatureType() == GCFeatureTypeCmd)) return false;
+
+    struct feature_write write;
+    write.isDouble = isDouble;
+    write.intValue = intValue;
+    write.doubleValue = doubleValue;
+    epicsTimeGetCurrent(&write.queued);
+    this->bulkWrites[function] = write;
+    return true;
+}
+
+static int bulkRank(std::string const & featureName) {
+    const int N = sizeof(bulk_order) / sizeof(bulk_order[0]);
+    for (int i=0; i<N; i++) {
+        if (featureName == bulk_order[i]) return i;
+    }
+    return N;
+}
+
+/** Write the collected features in dependency order, skipping the ones the camera already has,
+    then read all the features back once. Lock taken */
+asynStatus ADAravis::applyBulkWrites() {
+    const char *functionName = "applyBulkWrites";
+    epicsTimeStamp start, end;
+    int written = 0, skipped = 0;
+    std::vector<std::pair<int, int> > order;
+
+    if (this->bulkWrites.empty()) return asynSuccess;
+    if (!this->connectionValid) return asynError;
+    epicsTimeGetCurrent(&start);
+
+    for (auto &it : this->bulkWrites) {
+        order.push_back(std::make_pair(bulkRank(mGCFeatureSet.getByIndex(it.first)->getFeatureName()), it.first));
+    }
+    std::sort(order.begin(), order.end());
+
+    /* Move the offsets out of the way of the new size */
+    for (auto &it : order) {
+        GenICamFeature *pFeature = mGCFeatureSet.getByIndex(it.second);
+        std::string name = pFeature->getFeatureName();
+        if (((name == "OffsetX") || (name == "OffsetY")) && pFeature->isWritable()) {
+            pFeature->writeInteger(0);
+        }
+    }
+
+    for (auto &it : order) {
+        int function = it.second;
+        struct feature_write write = this->bulkWrites[function];
+        GenICamFeature *pFeature = mGCFeatureSet.getByIndex(function);
+        std::string name = pFeature->getFeatureName();
+        bool offset = (name == "OffsetX") || (name == "OffsetY");
+
+        if (!pFeature->isImplemented() || !pFeature->isWritable()) {
+            asynPrint(this->pasynUserSelf, ASYN_TRACE_WARNING,
+                "%s:%s: %s is not writable, not restored\n",
+                driverName, functionName, name.c_str());
+            continue;
+        }
+        /* Compare with the camera, the parameter library may not have been read from it yet */
+        epicsInt64 intValue = write.isDouble ? (epicsInt64) write.doubleValue : write.intValue;
+        double doubleValue = write.isDouble ? write.doubleValue : write.intValue;
+        bool same = false;
+        switch (pFeature->getFeatureType()) {
+            case GCFeatureTypeInteger:
+                same = pFeature->isReadable() && (pFeature->readInteger() == intValue);
+                if (offset || !same) pFeature->writeInteger(intValue);
+                break;
+            case GCFeatureTypeDouble:
+                same = pFeature->isReadable() && (pFeature->readDouble() == doubleValue);
+                if (!same) pFeature->writeDouble(doubleValue);
+                break;
+            case GCFeatureTypeBoolean:
+                same = pFeature->isReadable() && (pFeature->readBoolean() == (write.intValue != 0));
+                if (!same) pFeature->writeBoolean(write.intValue != 0);
+                break;
+            case GCFeatureTypeEnum:
+                same = pFeature->isReadable() && (pFeature->readEnumIndex() == write.intValue);
+                if (!same) pFeature->writeEnumIndex(write.intValue);
+                break;
+            default:
+                continue;
+        }
+        /* The offsets were moved to 0 above, so they are always written */
+        if (same && !offset) {
+            skipped++;
+            continue;
+        }
+        written++;
+    }
+    this->bulkWrites.clear();
+
+    /* One read back of everything, rather than one per write */
+    mGCFeatureSet.readFeatures();
+
+    epicsTimeGetCurrent(&end);
+    setDoubleParam(AravisBulkApplyTime, epicsTimeDiffInSeconds(&end, &start));
+    setIntegerParam(AravisBulkWritten, written);
+    setIntegerParam(AravisBulkSkipped, skipped);
+    asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW,
+        "%s:%s: wrote %d features, skipped %d, in %.3f s\n",
+        driverName, functionName, written, skipped, epicsTimeDiffInSeconds(&end, &start));
+    callParamCallbacks();
+    return asynSuccess;
+}
+
+/** Turn the notification of the events in event_lookup on or off in the camera,
+    and get the event IDs that the camera will send for them.
+    this->camera exists, lock taken */
+asynStatus ADAravis::enableEvents(int enable) {
+    const char *functionName = "enableEvents";
+    int active = 0;
+
+    if (!g_signal_lookup("device-event", G_OBJECT_TYPE(this->device))) {
+        asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+            "%s:%s: this version of aravis does not deliver device events\n",
+            driverName, functionName);
+        setIntegerParam(AravisEventsActive, 0);
+        return enable ? asynError : asynSuccess;
+    }
+    for (int i=0; i<NUM_EVENTS; i++) {
+        GErrorHelper err;
+        std::string idFeature = std::string("Event") + event_lookup[i].name;
+        this->eventIds[i] = -1;
+        if (!arv_device_get_feature(this->device, idFeature.c_str())) continue;
+        arv_device_set_string_feature_value(this->device, "EventSelector", event_lookup[i].name, err.get());
+        if (!err) arv_device_set_string_feature_value(this->device, "EventNotification", enable ? "On" : "Off", err.get());
+        if (err) {
+            asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+                "%s:%s: cannot set notification of %s event, err=%s\n",
+                driverName, functionName, event_lookup[i].name, err->message);
+            continue;
+        }
+        if (!enable) continue;
+        this->eventIds[i] = (int) arv_device_get_integer_feature_value(this->device, idFeature.c_str(), NULL);
+        active++;
+    }
+    setIntegerParam(AravisEventsActive, active);
+    return asynSuccess;
+}
+
+/** Publish the device events as they arrive. Only the features holding the data of that event
+    (Event<name>Timestamp, Event<name>FrameID, ...) are read back, the rest of the features are untouched */
+void ADAravis::eventTask() {
+    struct device_event event;
+    int count;
+
+    while (1) {
+        if (epicsMessageQueueReceive(this->eventQId, &event, sizeof(event)) != sizeof(event)) continue;
+        this->lock();
+        std::string prefix = std::string("Event") + event_lookup[event.index].name;
+        std::string timestampFeature = prefix + "Timestamp";
+        for (auto pFeature : this->featureList) {
+            std::string name = pFeature->getFeatureName();
+            if ((name.size() > prefix.size()) && (name.compare(0, prefix.size(), prefix) == 0)) {
+                pFeature->read(NULL, true);
+            }
+        }
+        if (this->device && arv_device_get_feature(this->device, timestampFeature.c_str())) {
+            /* Device ticks, in the same units as the frame timestamps */
+            gint64 ticks = arv_device_get_integer_feature_value(this->device, timestampFeature.c_str(), NULL);
+            setDoubleParam(AravisEventTime[event.index], ticks / 1.e9);
+        }
+        getIntegerParam(AravisEventCount[event.index], &count);
+        setIntegerParam(AravisEventCount[event.index], count + 1);
+        /* Records with TSE=-2 get the time the event arrived */
+        setTimeStamp(&event.time);
+        callParamCallbacks();
+        this->unlock();
+    }
+}
+
+/** Trigger thread, sends the software triggers requested by writing AravisSoftTrigger.
+    It does not take the lock, so the trigger does not wait for the port or the frames being processed */
+void ADAravis::triggerTask() {
+    const char *functionName = "triggerTask";
+
+    while (1) {
+        epicsEventWait(this->triggerEvent);
+        while (this->triggerRequests > 0) {
+            this->triggerRequests--;
+            GErrorHelper err;
+            this->triggerNodeLock.lock();
+            if (this->triggerNode) {
+                gint64 sent = g_get_real_time();
+                this->triggerLock.lock();
+                this->triggerTimes.push_back(sent);
+                this->triggerCount++;
+                this->triggerLock.unlock();
+                arv_gc_command_execute(ARV_GC_COMMAND(this->triggerNode), err.get());
+                if (err) {
+                    this->triggerLock.lock();
+                    if (!this->triggerTimes.empty()) this->triggerTimes.pop_back();
+                    this->triggerCount--;
+                    this->triggerLock.unlock();
+                }
+            }
+            this->triggerNodeLock.unlock();
+            if (err) {
+                asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+                            "%s:%s: TriggerSoftware failed, err=%s\n",
+                            driverName, functionName, err->message);
+            }
+        }
+    }
+}
+
+/** Replay thread. Feeds the frames of the raw capture named by ARAVIS_REPLAY_FILE to processBuffer as if they
+    had come from their streams, with the gaps they were recorded with or as fast as possible, so the frame
+    processing can be measured and debugged without the camera. The file is read without the lock */
+void ADAravis::replayTask() {
+    const char *functionName = "replayTask";
+    arvRawReader reader;
+    struct raw_frame frame;
+    std::string fileName;
+    int mode, loop, frames, lastFrames;
+    double processTime;
+    epicsTimeStamp passStart, lastUpdate, before, after;
+
+    while (1) {
+        epicsEventWait(this->replayEvent);
+        if (!this->replaying) continue;
+        this->lock();
+        getStringParam(AravisReplayFile, fileName);
+        getIntegerParam(AravisReplayMode, &mode);
+        getIntegerParam(AravisReplayLoop, &loop);
+        setIntegerParam(AravisReplayFrames, 0);
+        setDoubleParam(AravisReplayRate, 0);
+        setDoubleParam(AravisReplayTime, 0);
+        callParamCallbacks();
+        this->unlock();
+        frames = 0;
+        lastFrames = 0;
+        processTime = 0;
+        if (!reader.open(fileName.c_str()) || (reader.numFrames() == 0)) {
+            asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+                        "%s:%s: cannot replay %s: %s\n", driverName, functionName, fileName.c_str(),
+                        *reader.errorMessage() ? reader.errorMessage() : "no frames");
+            this->replaying = false;
+        } else {
+            asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW,
+                        "%s:%s: replaying %lu frames from %s\n", driverName, functionName,
+                        (unsigned long) reader.numFrames(), fileName.c_str());
+        }
+        epicsTimeGetCurrent(&lastUpdate);
+        while (this->replaying) {
+            /* Each pass starts again from the time of the first frame */
+            epicsTimeGetCurrent(&passStart);
+            const arvRawEntry &first = reader.entry(0);
+            for (size_t i=0; (i<reader.numFrames()) && this->replaying; i++) {
+                const arvRawEntry &e = reader.entry(i);
+                if (mode == AravisReplayOriginal) {
+                    /* The host clock of the recording, which older aravis versions do not set */
+                    double offset = e.systemTimestamp ? (e.systemTimestamp - first.systemTimestamp) / 1.e9
+                                                      : (e.timestamp - first.timestamp) / 1.e9;
+                    epicsTimeGetCurrent(&before);
+                    double delay = offset - epicsTimeDiffInSeconds(&before, &passStart);
+                    /* Writing ARAVIS_REPLAY to 0 wakes this up */
+                    if (delay > 0) epicsEventWaitWithTimeout(this->replayEvent, delay);
+                    if (!this->replaying) break;
+                }
+                size_t dims = (size_t) e.size;
+                frame.pRaw = this->pNDArrayPool->alloc(1, &dims, NDUInt8, 0, NULL);
+                if (frame.pRaw == NULL) {
+                    asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+                                "%s:%s: error allocating frame %lu\n", driverName, functionName, (unsigned long) i);
+                    this->replaying = false;
+                    break;
+                }
+                frame.meta = e;
+                if (!reader.readFrame(i, frame.pRaw->pData)) {
+                    asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+                                "%s:%s: frame %lu: %s\n", driverName, functionName, (unsigned long) i,
+                                reader.errorMessage());
+                    frame.pRaw->release();
+                    this->replaying = false;
+                    break;
+                }
+                this->lock();
+                /* Frames of streams this camera does not have are skipped */
+                epicsTimeGetCurrent(&before);
+                if (e.stream < this->streams.size()) {
+                    this->processBuffer(this->streams[e.stream], &frame);
+                    frames++;
+                }
+                epicsTimeGetCurrent(&after);
+                processTime += epicsTimeDiffInSeconds(&after, &before);
+                frame.pRaw->release();
+                double elapsed = epicsTimeDiffInSeconds(&after, &lastUpdate);
+                if (elapsed >= 1.0) {
+                    setIntegerParam(AravisReplayFrames, frames);
+                    setDoubleParam(AravisReplayRate, (frames - lastFrames) / elapsed);
+                    setDoubleParam(AravisReplayTime, frames ? processTime / frames * 1000. : 0.);
+                    callParamCallbacks();
+                    lastFrames = frames;
+                    lastUpdate = after;
+                }
+                this->unlock();
+            }
+            if (!loop) break;
+        }
+        reader.close();
+        this->lock();
+        this->replaying = false;
+        setIntegerParam(AravisReplayFrames, frames);
+        setDoubleParam(AravisReplayRate, 0);
+        setDoubleParam(AravisReplayTime, frames ? processTime / frames * 1000. : 0.);
+        setIntegerParam(AravisReplay, 0);
+        callParamCallbacks();
+        this->unlock();
+    }
+}
+
+/** Match a stream 0 frame with the oldest software trigger waiting for one, and add the time from sending
+    the trigger to the arrival of the frame to the histogram. Called by the aravis callback */
+void ADAravis::triggerFrame(ArvBuffer *buffer) {
+    /* The system timestamp is taken by aravis when the frame starts to arrive */
+    guint64 systemTimestamp = arv_buffer_get_system_timestamp(buffer);
+    gint64 arrived = systemTimestamp ? (gint64)(systemTimestamp / 1000) : g_get_real_time();
+
+    this->triggerLock.lock();
+    while (!this->triggerTimes.empty()) {
+        double latency = (arrived - this->triggerTimes.front()) / 1.e3;
+        /* A frame from before the trigger, e.g. the camera is not in trigger mode */
+        if (latency < 0) break;
+        this->triggerTimes.pop_front();
+        /* The frame of this trigger was lost, try the next one */
+        if (latency > TRIGGER_TIMEOUT * 1.e3) {
+            this->triggerMissed++;
+            continue;
+        }
+        this->triggerLatency = latency;
+        this->triggerLatencySum += latency;
+        if (latency > this->triggerLatencyMax) this->triggerLatencyMax = latency;
+        this->triggerLatencies++;
+        int bin = std::min((int)(latency / this->triggerHistBin), TRIGGER_HIST_SIZE - 1);
+        this->triggerHist[bin]++;
+        this->triggerHistNew = true;
+        break;
+    }
+    this->triggerLock.unlock();
+}
+
+/** Make the table that maps the 16 bit pixels to 8 bits, from the window LUTMin to LUTMax. Lock taken */
+void ADAravis::buildLUT() {
+    int mode, minValue, maxValue;
+    double gamma;
+
+    getIntegerParam(AravisLUTMode, &mode);
+    getIntegerParam(AravisLUTMin, &minValue);
+    getIntegerParam(AravisLUTMax, &maxValue);
+    getDoubleParam(AravisLUTGamma, &gamma);
+    double range = std::max(maxValue - minValue, 1);
+    this->lutOffset = (float) minValue;
+    this->lutScale = (float) (255. / range);
+
+    /* The linear window is calculated, the table is only filled for the other modes */
+    std::vector<epicsUInt8> *pTable = new std::vector<epicsUInt8>(65536, 0);
+    if ((mode == AravisLUTGamma) || (mode == AravisLUTLog)) {
+        for (int i = 0; i < 65536; i++) {
+            double t = std::min(std::max(i - minValue, 0), (int) range);
+            double v;
+            if (mode == AravisLUTGamma) {
+                v = 255. * pow(t / range, 1. / gamma);
+            } else {
+                v = 255. * log1p(t) / log1p(range);
+            }
+            (*pTable)[i] = (epicsUInt8) std::min(v + 0.5, 255.);
+        }
+    }
+    this->lut.reset(pTable);
+}
+
+/** Clear the software trigger counters and latencies. Lock taken */
+void ADAravis::resetTriggerStatistics() {
+    this->triggerLock.lock();
+    this->triggerTimes.clear();
+    this->triggerCount = 0;
+    this->triggerMissed = 0;
+    this->triggerLatencies = 0;
+    this->triggerLatency = 0;
+    this->triggerLatencySum = 0;
+    this->triggerLatencyMax = 0;
+    std::fill(this->triggerHist.begin(), this->triggerHist.end(), 0);
+    this->triggerHistNew = true;
+    this->triggerLock.unlock();
+    this->updateTriggerStatistics();
+}
+
+/** Publish the software trigger counters, latencies in ms and histogram. Lock taken */
+void ADAravis::updateTriggerStatistics() {
+    std::vector<epicsInt32> hist;
+    gint64 now = g_get_real_time();
+
+    this->triggerLock.lock();
+    /* Triggers whose frame never came */
+    while (!this->triggerTimes.empty() && ((now - this->triggerTimes.front()) > TRIGGER_TIMEOUT * 1.e6)) {
+        this->triggerTimes.pop_front();
+        this->triggerMissed++;
+    }
+    setIntegerParam(AravisTriggerCount, this->triggerCount);
+    setIntegerParam(AravisTriggerMissed, this->triggerMissed);
+    setDoubleParam(AravisTriggerLatency, this->triggerLatency);
+    setDoubleParam(AravisTriggerLatencyMean,
+                   this->triggerLatencies ? this->triggerLatencySum / this->triggerLatencies : 0);
+    setDoubleParam(AravisTriggerLatencyMax, this->triggerLatencyMax);
+    if (this->triggerHistNew) {
+        this->triggerHistNew = false;
+        hist = this->triggerHist;
+    }
+    this->triggerLock.unlock();
+    if (!hist.empty()) doCallbacksInt32Array(hist.data(), hist.size(), AravisTriggerHist, 0);
+}
+
+/** Prepare the memory of an NDArray from the pool the first time it is used as a frame buffer.
+    The pool keeps its arrays when they are released, so later acquisitions reuse the same locked pages,
+    and it unlocks them when it frees the memory. Called with or without the lock */
+void ADAravis::prepareArray(NDArray *pArray) {
+    int mode = this->arenaMode;
+
+    if (mode == AravisArenaOff) return;
+    this->arrayPool->prepare(pArray->pData, pArray->dataSize, mode == AravisArenaHugePages, this->arenaNumaNode);
+}
+
+/** In ring mode, keep a stream 0 frame in the ring rather than processing it, and give the stream a buffer
+    in its place: the oldest frames in the ring once ARAVIS_RING_MEMORY is used, otherwise a new one.
+    Returns false if the frame is to be processed now, which is the case for the post-trigger frames.
+    Lock taken */
+bool ADAravis::ringHold(aravisStream *pStream, ArvBuffer *buffer) {
+    int ringMode;
+    double ringMemory;
+    bool replaced = false;
+
+    getIntegerParam(AravisRing, &ringMode);
+    if (!ringMode || (pStream->index != 0)) return false;
+    if (this->ringPostRemaining > 0) {
+        if (--this->ringPostRemaining == 0) setIntegerParam(AravisRingTrigger, 0);
+        return false;
+    }
+
+    /* A frame of the old stream is held without giving the new stream a buffer for it */
+    if (!currentBuffer(pStream, buffer)) replaced = true;
+
+    struct ring_frame frame;
+    frame.buffer = buffer;
+    frame.payload = pStream->payload;
+    updateTimeStamp(&frame.time);
+    this->ring.push_back(frame);
+    this->ringBytes += frame.payload;
+
+    getDoubleParam(AravisRingMemory, &ringMemory);
+    while ((this->ringBytes > ringMemory * 1.e6) && (this->ring.size() > 1)) {
+        struct ring_frame oldest = this->ring.front();
+        this->ring.pop_front();
+        this->ringBytes -= oldest.payload;
+        /* Reuse the buffer as it is, unless the stream has been made again since */
+        if (!replaced && currentBuffer(pStream, oldest.buffer) && pStream->stream) {
+            arv_stream_push_buffer(pStream->stream, oldest.buffer);
+            replaced = true;
+        } else {
+            g_object_unref(oldest.buffer);
+        }
+    }
+    if (!replaced && (this->allocBuffer(pStream) != asynSuccess) && (this->ring.size() > 1)) {
+        /* The pool is full, so the ring cannot grow */
+        struct ring_frame oldest = this->ring.front();
+        this->ring.pop_front();
+        this->ringBytes -= oldest.payload;
+        g_object_unref(oldest.buffer);
+        this->refillBuffers(pStream, 1);
+    }
+    setIntegerParam(AravisRingFrames, (int) this->ring.size());
+    return true;
+}
+
+/** Process all the frames held in the ring, oldest first, with the time they arrived.
+    Lock taken, but released by processBuffer */
+void ADAravis::ringFlush(aravisStream *pStream) {
+    struct raw_frame raw;
+
+    this->ringFlushPending = false;
+    while (!this->ring.empty()) {
+        struct ring_frame frame = this->ring.front();
+        this->ring.pop_front();
+        this->ringBytes -= frame.payload;
+        setIntegerParam(AravisRingFrames, (int) this->ring.size());
+        describeBuffer(frame.buffer, pStream->index, &raw);
+        this->processBuffer(pStream, &raw, &frame.time);
+        g_object_unref(frame.buffer);
+    }
+    if (this->ringPostRemaining == 0) setIntegerParam(AravisRingTrigger, 0);
+}
+
+/** Discard the frames held in the ring. Lock taken */
+void ADAravis::ringClear() {
+    for (auto &frame : this->ring) {
+        g_object_unref(frame.buffer);
+    }
+    this->ring.clear();
+    this->ringBytes = 0;
+    this->ringPostRemaining = 0;
+    this->ringFlushPending = false;
+    setIntegerParam(AravisRingFrames, 0);
+    setIntegerParam(AravisRingTrigger, 0);
+}
+
+/** Parameters that change the image format, and so possibly the payload */
+bool ADAravis::isImageFormatParam(int function) {
+    static const char *formatFeatures[] = {
+        "PixelFormat", "Width", "Height", "OffsetX", "OffsetY",
+        "BinningHorizontal", "BinningVertical", "DecimationHorizontal", "DecimationVertical"
+    };
+
+    if ((function == ADSizeX) || (function == ADSizeY) || (function == ADMinX) || (function == ADMinY) ||
+        (function == ADBinX) || (function == ADBinY) || (function == NDColorMode) || (function == NDDataType))
+        return true;
+    if ((function >= FIRST_ARAVIS_CAMERA_PARAM) && (function <= LAST_ARAVIS_CAMERA_PARAM)) return false;
+    GenICamFeature *pFeature = mGCFeatureSet.getByIndex(function);
+    if (!pFeature) return false;
+    std::string name = pFeature->getFeatureName();
+    for (unsigned int i=0; i<sizeof(formatFeatures)/sizeof(formatFeatures[0]); i++) {
+        if (name == formatFeatures[i]) return true;
+    }
+    return false;
+}
+
+/** True if image format changes are to be done without stopping acquisition. Lock taken */
+bool ADAravis::liveReconfigActive() {
+    int acquire, liveReconfig;
+
+    getIntegerParam(ADAcquire, &acquire);
+    getIntegerParam(AravisLiveReconfig, &liveReconfig);
+    return acquire && liveReconfig;
+}
+
+/** Change the image format while acquiring: stop the camera, do the write, make new streams with
+    buffers of the new size if the payload has changed, and start again without resetting the counters.
+    The frames already in the queues are still processed. With pasynUser NULL just resize the buffers.
+    isFloat selects whether value or dvalue is written. this->camera exists, lock taken */
+asynStatus ADAravis::reconfigureLive(asynUser *pasynUser, epicsInt32 value, epicsFloat64 dvalue, bool isFloat) {
+    const char *functionName = "reconfigureLive";
+    asynStatus status = asynSuccess;
+    epicsTimeStamp start, end;
+    GErrorHelper err;
+    int numBuffers, count;
+    bool resize = false;
+
+    epicsTimeGetCurrent(&start);
+    arv_camera_stop_acquisition(this->camera, NULL);
+    if (pasynUser) {
+        status = isFloat ? ADGenICam::writeFloat64(pasynUser, dvalue) : ADGenICam::writeInt32(pasynUser, value);
+    }
+
+    for (auto pStream : this->streams) {
+        if (this->getStreamPayload(pStream->index) != pStream->payload) resize = true;
+    }
+    if (resize || !pasynUser) {
+        /* The old buffers are too small. The ones already queued hold complete frames and are still processed */
+        this->makeStreamObject();
+        getIntegerParam(AravisNumBuffers, &numBuffers);
+        for (auto pStream : this->streams) {
+            pStream->payload = this->getStreamPayload(pStream->index);
+            for (int i=0; i<numBuffers; i++) {
+                if (this->allocBuffer(pStream) != asynSuccess) {
+                    asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+                                "%s:%s: allocBuffer returned error\n",
+                                driverName, functionName);
+                    status = asynError;
+                    break;
+                }
+            }
+        }
+    }
+    arv_camera_start_acquisition(this->camera, err.get());
+    if (err) {
+        asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+                    "%s:%s: cannot restart acquisition, err=%s\n",
+                    driverName, functionName, err->message);
+        status = asynError;
+    }
+
+    epicsTimeGetCurrent(&end);
+    setDoubleParam(AravisReconfigTime, epicsTimeDiffInSeconds(&end, &start) * 1.e3);
+    getIntegerParam(AravisReconfigCount, &count);
+    setIntegerParam(AravisReconfigCount, count + 1);
+    return status;
+}
+
+/** Decide whether this stream 0 frame also goes to the live view address,
+    keeping every ARAVIS_LIVE_DECIMATE frame and at most ARAVIS_LIVE_MAX_RATE frames per second.
+    Lock taken */
+bool ADAravis::publishLive() {
+    int liveDecimate;
+    double liveMaxRate;
+    epicsTimeStamp now;
+
+    getIntegerParam(AravisLiveDecimate, &liveDecimate);
+    getDoubleParam(AravisLiveMaxRate, &liveMaxRate);
+    if (liveDecimate < 1) return false;
+    if (++this->liveCounter < liveDecimate) return false;
+    if (liveMaxRate > 0) {
+        epicsTimeGetCurrent(&now);
+        if (epicsTimeDiffInSeconds(&now, &this->lastLiveTime) < 1. / liveMaxRate) return false;
+        this->lastLiveTime = now;
+    }
+    this->liveCounter = 0;
+    return true;
+}
+
+/** Publish the stream statistics, summed over all streams, and the values derived from them.
+    Lock taken */
+void ADAravis::updateStatistics() {
+    guint64 n_completed_buffers, n_failures, n_underruns;
+    guint64 completed = 0, failures = 0, underruns = 0, resent = 0, missing = 0;
+    guint64 transferred = 0, ignored = 0;
+    int droppedNewest = 0, droppedOldest = 0, blocked = 0, highWater = 0;
+    int allocFailures = 0, queuePending = 0;
+    gint streamInput = 0, streamOutput = 0;
+    bool gvStream = false, uvStream = false;
+    for (auto pS : this->streams) {
+        droppedNewest += pS->droppedNewest;
+        droppedOldest += pS->droppedOldest;
+        blocked       += pS->blocked;
+        allocFailures += pS->allocFailures;
+        queuePending  += epicsMessageQueuePending(pS->msgQId);
+        if (pS->highWater > highWater) highWater = pS->highWater;
+        if (pS->stream == NULL) continue;
+        gint nInput, nOutput;
+        arv_stream_get_n_buffers(pS->stream, &nInput, &nOutput);
+        streamInput  += nInput;
+        streamOutput += nOutput;
+        arv_stream_get_statistics(pS->stream, &n_completed_buffers, &n_failures, &n_underruns);
+        completed += n_completed_buffers;
+        failures  += n_failures;
+        underruns += n_underruns;
+
+        if (ARV_IS_GV_STREAM(pS->stream)) {
+            guint64 n_resent_pkts, n_missing_pkts;
+            arv_gv_stream_get_statistics(ARV_GV_STREAM(pS->stream), &n_resent_pkts, &n_missing_pkts);
+            resent  += n_resent_pkts;
+            missing += n_missing_pkts;
+            gvStream = true;
+        }
+#if ARAVIS_VERSION_CURRENT >= ARAVIS_VERSION_INT(0, 8, 11)
+        if (ARV_IS_UV_STREAM(pS->stream)) {
+            transferred += arv_stream_get_info_uint64_by_name(pS->stream, "n_transferred_bytes");
+            ignored     += arv_stream_get_info_uint64_by_name(pS->stream, "n_ignored_bytes");
+            uvStream = true;
+        }
+#endif
+    }
+    setDoubleParam(AravisCompleted, (double) completed);
+    setDoubleParam(AravisFailures, (double) failures);
+    setDoubleParam(AravisUnderruns, (double) underruns);
+    setIntegerParam(AravisDroppedNewest, droppedNewest);
+    setIntegerParam(AravisDroppedOldest, droppedOldest);
+    setIntegerParam(AravisQueueBlocked, blocked);
+    setIntegerParam(AravisQueueHighWater, highWater);
+    /* Where the buffers are: waiting for data, filled but not yet taken by the callback, in the frame queue,
+     * or out of the pool and none of these, which means held by the plugins */
+    setIntegerParam(AravisStreamInput, streamInput);
+    setIntegerParam(AravisStreamOutput, streamOutput);
+    setIntegerParam(AravisQueuePending, queuePending);
+    setIntegerParam(AravisAllocFailures, allocFailures);
+    int deficit = 0, reserveDrops = 0;
+    for (auto pS : this->streams) {
+        deficit      += pS->deficit;
+        reserveDrops += pS->reserveDrops;
+    }
+    setIntegerParam(AravisBufferDeficit, deficit);
+    setIntegerParam(AravisReserveDrops, reserveDrops);
+    int held = this->pNDArrayPool->getNumBuffers() - this->pNDArrayPool->getNumFree()
+               - streamInput - streamOutput - queuePending - (int) this->ring.size();
+    setIntegerParam(AravisHeldDownstream, held > 0 ? held : 0);
+    setDoubleParam(AravisArenaLocked, this->arrayPool->getLocked() / 1.e6);
+    if (this->recording) this->updateRecordStatistics();
+    if (this->statsHistNew) {
+        this->statsHistNew = false;
+        doCallbacksInt32Array(this->statsHist.data(), this->statsHist.size(), AravisStatsHist, 0);
+    }
+    this->updateTriggerStatistics();
+    /* The callers do the callbacks for address 0, the other streams have their counters and sizes on their own */
+    for (auto pS : this->streams) {
+        if ((pS->index != 0) && (pS->index < this->maxAddr)) callParamCallbacks(pS->index);
+    }
+    int shmFrames, shmSkipped;
+    this->shmRing.getStatistics(&shmFrames, &shmSkipped);
+    setIntegerParam(AravisShmFrames, shmFrames);
+    setIntegerParam(AravisShmSkipped, shmSkipped);
+    if (gvStream) {
+        setIntegerParam(AravisResentPkts,  (epicsInt32) resent);
+        setIntegerParam(AravisMissingPkts, (epicsInt32) missing);
+    }
+    /* CPU time per frame of the threads that receive the streams, to compare the receive modes */
+    epicsTimeStamp now;
+    epicsTimeGetCurrent(&now);
+    if ((double) completed < this->lastCpuFrames) this->lastCpuFrames = 0;
+    if ((epicsTimeDiffInSeconds(&now, &this->lastCpuSample) >= 1.0) && ((double) completed > this->lastCpuFrames)) {
+        double cpuTime = this->receiveCpuTime();
+        /* New streams have new threads, so start again */
+        if (cpuTime >= this->lastCpuTime) {
+            setDoubleParam(AravisCpuPerFrame, (cpuTime - this->lastCpuTime) / (completed - this->lastCpuFrames) * 1.e3);
+        }
+        this->lastCpuTime = cpuTime;
+        this->lastCpuFrames = (double) completed;
+        this->lastCpuSample = now;
+    }
+    if (uvStream) {
+        double elapsed = epicsTimeDiffInSeconds(&now, &this->lastTransferTime);
+        setDoubleParam(AravisTransferredBytes, (double) transferred);
+        setDoubleParam(AravisIgnoredBytes, (double) ignored);
+        /* The stream counters restart with each new stream */
+        if ((double) transferred < this->lastTransferredBytes) this->lastTransferredBytes = 0;
+        if (elapsed >= 1.0) {
+            setDoubleParam(AravisTransferRate, (transferred - this->lastTransferredBytes) / elapsed / 1.e6);
+            this->lastTransferredBytes = (double) transferred;
+            this->lastTransferTime = now;
+        }
+    }
+}
+
+/** Publish the statistics and the frame counters set by processBuffer at ARAVIS_STATUS_RATE,
+    so that a fast camera does not post a monitor for every frame */
+void ADAravis::statusTask() {
+    double statusRate;
+
+    /* Wait for database to be up */
+    while (!iocRunning) {
+        epicsThreadSleep(0.1);
+    }
+
+    /* Apply the settings restored while the IOC started, if this camera is still collecting them */
+    this->lock();
+    int bulkApply;
+    getIntegerParam(AravisBulkApply, &bulkApply);
+    if (bulkApply) {
+        this->applyBulkWrites();
+        setIntegerParam(AravisBulkApply, 0);
+        callParamCallbacks();
+    }
+    this->unlock();
+
+    while (1) {
+        this->lock();
+        /* A stream thread found frames that no longer fit the buffers */
+        if (this->reconfigPending) {
+            this->reconfigPending = false;
+            if (this->liveReconfigActive()) this->reconfigureLive(NULL, 0, 0., false);
+            callParamCallbacks();
+        }
+        getDoubleParam(AravisStatusRate, &statusRate);
+        if (statusRate > 0) {
+            this->updateStatistics();
+            callParamCallbacks();
+        }
+        this->unlock();
+        /* When publishing with every frame, just wait for the rate to change */
+        epicsEventWaitWithTimeout(this->statusEvent, statusRate > 0 ? 1. / statusRate : 1.);
+    }
+}
+
+/** Read the software crop, binning and decimation settings.
+  * Returns true if any of them would change the frame */
+bool ADAravis::getSoftwareReduce(struct sw_reduce *reduce) {
+    getIntegerParam(AravisSWMinX,     &reduce->minX);
+    getIntegerParam(AravisSWMinY,     &reduce->minY);
+    getIntegerParam(AravisSWSizeX,    &reduce->sizeX);
+    getIntegerParam(AravisSWSizeY,    &reduce->sizeY);
+    getIntegerParam(AravisSWBin,      &reduce->bin);
+    getIntegerParam(AravisSWBinMode,  &reduce->mode);
+    getIntegerParam(AravisSWDecimate, &reduce->decimate);
+    return (reduce->bin > 1) || (reduce->decimate > 1) ||
+           (reduce->minX > 0) || (reduce->minY > 0) || (reduce->sizeX > 0) || (reduce->sizeY > 0);
+}
+
+/** Unpack n pixels of row y starting at column x0 into the line buffer, applying the 16-bit shift.
+  * Returns a pointer to the first pixel, which points into the source frame when no conversion is needed */
+const epicsUInt16 *ADAravis::unpackMonoLine(aravisStream *pStream, const epicsUInt8 *pData, int pixel_format, int width,
+                                            int y, int x0, int n, bool leftShift, int shiftDir, int shiftBits) {
+    size_t first = (size_t)y * width + x0;
+    epicsUInt16 *line = &pStream->lineBuffer[0];
+    const epicsUInt16 *pOut = line;
+
+    switch (pixel_format) {
+        case ARV_PIXEL_FORMAT_MONO_8:
+            for (int i = 0; i < n; i++) {
+                line[i] = pData[first + i];
+            }
+            /* 8-bit data are never shifted */
+            return line;
+        case ARV_PIXEL_FORMAT_MONO_12_P:
+        case ARV_PIXEL_FORMAT_MONO_12_PACKED: {
+            /* 2 pixels are packed in 3 bytes, so start on an even pixel */
+            size_t even = first & ~(size_t)1;
+            int skip = (int)(first - even);
+            int count = (n + skip + 1) & ~1;
+            if (pixel_format == ARV_PIXEL_FORMAT_MONO_12_P) {
+                decompressMono12p(count, leftShift, (epicsUInt8 *)pData + even / 2 * 3, line);
+            } else {
+                decompressMono12Packed(count, leftShift, (epicsUInt8 *)pData + even / 2 * 3, line);
+            }
+            line += skip;
+            pOut = line;
+            break;
+        }
+        default:
+            pOut = (const epicsUInt16 *)pData + first;
+            break;
+    }
+    if (shiftDir == AravisShiftLeft) {
+        for (int i = 0; i < n; i++) line[i] = pOut[i] << shiftBits;
+        pOut = line;
+    } else if (shiftDir == AravisShiftRight) {
+        for (int i = 0; i < n; i++) line[i] = pOut[i] >> shiftBits;
+        pOut = line;
+    }
+    return pOut;
+}
+
+/** Store one row of binned pixels, dividing by the number of pixels summed for mean binning */
+template <typename epicsType>
+static void storeBinnedLine(epicsType *pOut, const epicsUInt32 *acc, int n, epicsUInt32 divisor) {
+    if (divisor > 1) {
+        for (int i = 0; i < n; i++) pOut[i] = (epicsType)(acc[i] / divisor);
+    } else {
+        for (int i = 0; i < n; i++) pOut[i] = (epicsType)acc[i];
+    }
+}
+
+/** Crop, bin and decimate a mono frame.
+  * Each source row is unpacked and shifted into a line buffer and accumulated straight into the output NDArray,
+  * so the full size frame is never expanded. Sum binning widens the data type so it cannot overflow.
+  * On return reduce contains the crop that was actually applied. */
+NDArray *ADAravis::reduceMonoFrame(aravisStream *pStream, NDArray *pIn, size_t size, int pixel_format, int width, int height,
+                                   bool leftShift, int shiftDir, int shiftBits, struct sw_reduce *reduce) {
+    const char *functionName = "reduceMonoFrame";
+    int bitsPerPixel = ARV_PIXEL_FORMAT_BIT_PER_PIXEL(pixel_format);
+    size_t needed;
+
+    if ((pixel_format == ARV_PIXEL_FORMAT_MONO_12_P) || (pixel_format == ARV_PIXEL_FORMAT_MONO_12_PACKED)) {
+        needed = ((size_t)width * height + 1) / 2 * 3;
+    } else {
+        needed = (size_t)width * height * (bitsPerPixel > 8 ? 2 : 1);
+    }
+    if (size < needed) {
+        asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+                    "%s:%s: w: %d, h: %d, size: %zu, expected_size: %zu\n",
+                    driverName, functionName, width, height, size, needed);
+        return NULL;
+    }
+
+    /* Clip the crop to the frame */
+    if (reduce->minX > width - 1)  reduce->minX = width - 1;
+    if (reduce->minY > height - 1) reduce->minY = height - 1;
+    if ((reduce->sizeX == 0) || (reduce->sizeX > width - reduce->minX))   reduce->sizeX = width - reduce->minX;
+    if ((reduce->sizeY == 0) || (reduce->sizeY > height - reduce->minY))  reduce->sizeY = height - reduce->minY;
+    int bin = reduce->bin;
+    int step = bin * reduce->decimate;
+    if ((reduce->sizeX < bin) || (reduce->sizeY < bin)) {
+        asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+                    "%s:%s: software ROI %dx%d is smaller than binning %d\n",
+                    driverName, functionName, reduce->sizeX, reduce->sizeY, bin);
+        return NULL;
+    }
+    int outWidth  = (reduce->sizeX - bin) / step + 1;
+    int outHeight = (reduce->sizeY - bin) / step + 1;
+
+    /* Mean binning keeps the input type, sum binning uses the next larger type */
+    NDDataType_t outType;
+    if (reduce->mode == AravisSWBinSum && bin > 1) {
+        outType = (bitsPerPixel > 8) ? NDUInt32 : NDUInt16;
+    } else {
+        outType = (bitsPerPixel > 8) ? NDUInt16 : NDUInt8;
+    }
+    epicsUInt32 divisor = (reduce->mode == AravisSWBinMean) ? bin * bin : 1;
+
+    size_t dims[2] = {(size_t)outWidth, (size_t)outHeight};
+    NDArray *pOut = this->pNDArrayPool->alloc(2, dims, outType, 0, NULL);
+    if (pOut == NULL) {
+        asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+                    "%s:%s: error allocating reduced array\n",
+                    driverName, functionName);
+        return NULL;
+    }
+    this->prepareArray(pOut);
+
+    /* One spare pixel in case a packed row starts on an odd pixel */
+    if (pStream->lineBuffer.size() < (size_t)reduce->sizeX + 2) pStream->lineBuffer.resize(reduce->sizeX + 2);
+    pStream->binAccumulator.resize(outWidth);
+    epicsUInt32 *acc = &pStream->binAccumulator[0];
+
+    for (int oy = 0; oy < outHeight; oy++) {
+        memset(acc, 0, outWidth * sizeof(epicsUInt32));
+        for (int by = 0; by < bin; by++) {
+            const epicsUInt16 *line = this->unpackMonoLine(pStream, (const epicsUInt8 *)pIn->pData, pixel_format, width,
+                                                           reduce->minY + oy * step + by, reduce->minX, reduce->sizeX,
+                                                           leftShift, shiftDir, shiftBits);
+            if (bin == 1) {
+                for (int ox = 0; ox < outWidth; ox++) acc[ox] = line[ox * step];
+            } else {
+                for (int ox = 0; ox < outWidth; ox++) {
+                    const epicsUInt16 *p = line + ox * step;
+                    epicsUInt32 sum = 0;
+                    for (int bx = 0; bx < bin; bx++) sum += p[bx];
+                    acc[ox] += sum;
+                }
+            }
+        }
+        switch (outType) {
+            case NDUInt8:
+                storeBinnedLine((epicsUInt8 *)pOut->pData + (size_t)oy * outWidth, acc, outWidth, divisor);
+                break;
+            case NDUInt16:
+                storeBinnedLine((epicsUInt16 *)pOut->pData + (size_t)oy * outWidth, acc, outWidth, divisor);
+                break;
+            default:
+                storeBinnedLine((epicsUInt32 *)pOut->pData + (size_t)oy * outWidth, acc, outWidth, divisor);
+                break;
+        }
+    }
+    return pOut;
+}
+
+/** Open a recording named from the NDFile parameters if ARAVIS_RECORD is on. Lock taken */
+asynStatus ADAravis::openRecording() {
+    int record, bufferSize, autoIncrement, fileNumber;
+    char fullFileName[MAX_FILENAME_LEN];
+    std::string message;
+    const char *functionName = "openRecording";
+
+    this->closeRecording();
+    getIntegerParam(AravisRecord, &record);
+    if (!record) return asynSuccess;
+    getIntegerParam(AravisRecordBuffer, &bufferSize);
+    if (this->createFileName(sizeof(fullFileName), fullFileName) != asynSuccess) {
+        message = "cannot create the file name";
+    } else if (this->recorder.open(fullFileName, (size_t) bufferSize * 1000000, message)) {
+        message.clear();
+    }
+    if (!message.empty()) {
+        asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+                    "%s:%s: cannot record: %s\n", driverName, functionName, message.c_str());
+        setIntegerParam(NDFileWriteStatus, NDFileWriteError);
+        setStringParam(NDFileWriteMessage, message.c_str());
+        return asynError;
+    }
+    setStringParam(NDFullFileName, fullFileName);
+    setIntegerParam(NDFileWriteStatus, NDFileWriteOK);
+    setStringParam(NDFileWriteMessage, "");
+    getIntegerParam(NDAutoIncrement, &autoIncrement);
+    if (autoIncrement) {
+        getIntegerParam(NDFileNumber, &fileNumber);
+        setIntegerParam(NDFileNumber, fileNumber + 1);
+    }
+    setIntegerParam(AravisRecordFrames, 0);
+    setIntegerParam(AravisRecordDropped, 0);
+    setDoubleParam(AravisRecordRate, 0);
+    this->lastRecordBytes = 0;
+    epicsTimeGetCurrent(&this->lastRecordTime);
+    this->recording = true;
+    return asynSuccess;
+}
+
+/** Write out and close the current recording. Lock taken */
+void ADAravis::closeRecording() {
+    if (!this->recording) return;
+    this->recording = false;
+    this->recorder.close();
+    /* The final counts */
+    this->updateRecordStatistics();
+    setDoubleParam(AravisRecordRate, 0);
+}
+
+/** Publish the recorder counters and the rate it writes to disk. Lock taken */
+void ADAravis::updateRecordStatistics() {
+    int frames, dropped, writeErrno;
+    double bytesWritten;
+    bool direct;
+    epicsTimeStamp now;
+
+    this->recorder.getStatistics(&frames, &dropped, &bytesWritten, &direct, &writeErrno);
+    setIntegerParam(AravisRecordFrames, frames);
+    setIntegerParam(AravisRecordDropped, dropped);
+    setIntegerParam(AravisRecordDirect, direct ? 1 : 0);
+    if (writeErrno) {
+        setIntegerParam(NDFileWriteStatus, NDFileWriteError);
+        setStringParam(NDFileWriteMessage, strerror(writeErrno));
+    }
+    epicsTimeGetCurrent(&now);
+    double elapsed = epicsTimeDiffInSeconds(&now, &this->lastRecordTime);
+    if (elapsed >= 1.0) {
+        setDoubleParam(AravisRecordRate, (bytesWritten - this->lastRecordBytes) / elapsed / 1.e6);
+        this->lastRecordBytes = bytesWritten;
+        this->lastRecordTime = now;
+    }
+}
+
+/** Make the shared memory ring if ARAVIS_SHM is on. The segment is kept from one acquisition
+    to the next while the frames still fit, so readers stay attached. Lock taken */
+void ADAravis::openShm() {
+    int shmMode, numSlots;
+    std::string name, message;
+    const char *functionName = "openShm";
+
+    getIntegerParam(AravisShm, &shmMode);
+    if (shmMode == AravisShmOff) return;
+    getIntegerParam(AravisShmSlots, &numSlots);
+    getStringParam(AravisShmName, name);
+    if (name.empty()) name = std::string("/") + this->portName;
+    /* Unpacking Mono12p and Mono12Packed to 16 bits makes converted frames up to twice the payload */
+    size_t slotSize = 0;
+    for (auto pStream : this->streams) {
+        size_t size = pStream->payload;
+        if (shmMode == AravisShmConverted) size *= 2;
+        if (size > slotSize) slotSize = size;
+    }
+    if (this->shmRing.fits(name.c_str(), numSlots, slotSize)) return;
+    if (!this->shmRing.open(name.c_str(), numSlots, slotSize, message)) {
+        asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+                    "%s:%s: cannot make shared memory: %s\n", driverName, functionName, message.c_str());
+    }
+}
+
+/** Copy a frame into the shared memory ring, as it arrived if info is NULL, otherwise the converted NDArray.
+    Called without the lock */
+void ADAravis::publishShm(aravisStream *pStream, const struct raw_frame *pFrame, struct frame_info *info,
+                          const epicsTimeStamp *pTime) {
+    arvShmSlot slot;
+    const void *pData;
+    size_t size;
+
+    memset(&slot, 0, sizeof(slot));
+    slot.frameId         = pFrame->meta.frameId;
+    slot.timestamp       = pFrame->meta.timestamp;
+    slot.systemTimestamp = pFrame->meta.systemTimestamp;
+    slot.pixelFormat     = pFrame->meta.pixelFormat;
+    slot.stream          = pStream->index;
+    if (info) {
+        pData          = info->pArray->pData;
+        size           = info->size;
+        slot.converted = 1;
+        slot.epicsSec  = pTime->secPastEpoch;
+        slot.epicsNsec = pTime->nsec;
+        slot.dataType  = info->dataType;
+        slot.colorMode = info->colorMode;
+        slot.width     = info->width;
+        slot.height    = info->height;
+        slot.xOffset   = info->xOffset;
+        slot.yOffset   = info->yOffset;
+    } else {
+        pData        = pFrame->pRaw ? pFrame->pRaw->pData : NULL;
+        size         = pFrame->meta.size;
+        slot.width   = pFrame->meta.width;
+        slot.height  = pFrame->meta.height;
+        slot.xOffset = pFrame->meta.xOffset;
+        slot.yOffset = pFrame->meta.yOffset;
+    }
+    if (pData) this->shmRing.publish(pData, size, &slot);
+}
+
+asynStatus ADAravis::stopCapture() {
+    /* Stop the camera */
+    arv_camera_stop_acquisition(this->camera, NULL);
+    setIntegerParam(ADStatus, ADStatusIdle);
+    /* The new stream starts with no buffers owed, which puts back a reduced frame rate */
+    for (auto pStream : this->streams) {
+        pStream->deficit = 0;
+    }
+    this->updateThrottle();
+    this->closeRecording();
+    /* Tear down the old stream and make a new one */
+    return this->makeStreamObject();
+}
+
+asynStatus ADAravis::startCapture() {
+    int imageMode, numImages;
+    GErrorHelper err;
+    const char *functionName = "start";
+
+    /* The replay uses the streams */
+    if (this->replaying) {
+        asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+                    "%s:%s: cannot acquire while replaying\n", driverName, functionName);
+        return asynError;
+    }
+    
+    /* Make sure the camera has the settings the user just wrote */
+    if (!this->bulkWrites.empty()) this->applyBulkWrites();
+    while (this->doFeatureWrite());
+
+    getIntegerParam(ADImageMode, &imageMode);
+
+    if (imageMode == ADImageSingle) {
+        arv_camera_set_acquisition_mode(this->camera, ARV_ACQUISITION_MODE_SINGLE_FRAME, err.get());
+    } else if (imageMode == ADImageMultiple) {
+        if (mGCFeatureSet.getByName("AcquisitionFrameCount")) {
+            getIntegerParam(ADNumImages, &numImages);
+            arv_device_set_integer_feature_value(this->device, "AcquisitionFrameCount", numImages, err.get());
+        }
+        arv_camera_set_acquisition_mode(this->camera, ARV_ACQUISITION_MODE_MULTI_FRAME, err.get());
+    } else {
+        arv_camera_set_acquisition_mode(this->camera, ARV_ACQUISITION_MODE_CONTINUOUS, err.get());
+    }
+    setIntegerParam(ADNumImagesCounter, 0);
+    setIntegerParam(ADStatus, ADStatusAcquire);
+
+    /* Restart the rate and CPU time measurements, the stream counters restart with each new stream */
+    this->lastTransferredBytes = 0;
+    this->lastCpuFrames = 0;
+    this->lastCpuTime = this->receiveCpuTime();
+    epicsTimeGetCurrent(&this->lastCpuSample);
+    this->lastTransferTime = this->lastCpuSample;
+    for (int i=0; i<NUM_EVENTS; i++) {
+        setIntegerParam(AravisEventCount[i], 0);
+    }
+    /* A new acquisition starts with an empty ring */
+    this->ringClear();
+    if (this->openRecording() != asynSuccess) return asynError;
+    /* The first frame always goes to the live view */
+    getIntegerParam(AravisLiveDecimate, &this->liveCounter);
+    epicsTimeAddSeconds(&this->lastLiveTime, -1.e6);
+
+    /* The payloads are known now, so the shared memory slots can be sized */
+    for (auto pStream : this->streams) {
+        pStream->payload = this->getStreamPayload(pStream->index);
+    }
+    this->openShm();
+
+    /* fill the queues. For USB3 cameras in async mode this also sets how many frames can have transfers in flight */
+    int numBuffers, backPressure;
+    getIntegerParam(AravisNumBuffers, &numBuffers);
+    getIntegerParam(AravisBackPressure, &backPressure);
+    for (auto pStream : this->streams) {
+        pStream->arrayCounter = 0;
+        pStream->droppedNewest = 0;
+        pStream->droppedOldest = 0;
+        pStream->blocked = 0;
+        pStream->highWater = 0;
+        pStream->allocFailures = 0;
+        pStream->deficit = 0;
+        pStream->reserveDrops = 0;
+        for (int i=0; i<numBuffers; i++) {
+            if (this->allocBuffer(pStream) != asynSuccess) {
+                /* With back pressure the stream starts with what it can get, and is given the rest later */
+                if (backPressure && (i > 0)) {
+                    pStream->deficit = numBuffers - i;
+                    break;
+                }
+                asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR,
+                            "%s:%s: allocBuffer returned error\n",
+                            driverName, functionName);
+                return asynError;
+            }
+        }
+    }
+    this->updateThrottle();
+
+    // Start the camera acquiring
+    arv_camera_start_acquisition (this->camera, err.get());
+    return asynSuccess;
 }
 
 /** Lookup an ArvPixelFormat from a colorMode, dataType and bayerFormat */
@@ -1005,9 +4234,9 @@ asynStatus ADAravis::lookupPixelFormat(int colorMode, int dataType, int bayerFor
 
 /** Configuration command, called directly or from iocsh */
 extern "C" int ADAravisConfig(const char *portName, const char *cameraName, int enableCaching,
-                              size_t maxMemory, int priority, int stackSize)
+                              size_t maxMemory, int priority, int stackSize, int numStreams)
 {
-    new ADAravis(portName, cameraName, enableCaching, maxMemory, priority, stackSize);
+    new ADAravis(portName, cameraName, enableCaching, maxMemory, priority, stackSize, numStreams);
     return(asynSuccess);
 }
 
@@ -1018,17 +4247,69 @@ static const iocshArg ADAravisConfigArg2 = {"enable caching", iocshArgInt};
 static const iocshArg ADAravisConfigArg3 = {"maxMemory", iocshArgInt};
 static const iocshArg ADAravisConfigArg4 = {"priority", iocshArgInt};
 static const iocshArg ADAravisConfigArg5 = {"stackSize", iocshArgInt};
+static const iocshArg ADAravisConfigArg6 = {"numStreams", iocshArgInt};
 static const iocshArg * const ADAravisConfigArgs[] =  {&ADAravisConfigArg0,
                                                        &ADAravisConfigArg1,
                                                        &ADAravisConfigArg2,
                                                        &ADAravisConfigArg3,
                                                        &ADAravisConfigArg4,
-                                                       &ADAravisConfigArg5};
-static const iocshFuncDef configADAravis = {"aravisConfig", 6, ADAravisConfigArgs};
+                                                       &ADAravisConfigArg5,
+                                                       &ADAravisConfigArg6};
+static const iocshFuncDef configADAravis = {"aravisConfig", 7, ADAravisConfigArgs};
 static void configADAravisCallFunc(const iocshArgBuf *args)
 {
     ADAravisConfig(args[0].sval, args[1].sval, args[2].ival, 
-                   args[3].ival, args[4].ival, args[5].ival);
+                   args[3].ival, args[4].ival, args[5].ival, args[6].ival);
+}
+
+
+/** Set the seconds between the background refreshes of the camera list shared by the aravis cameras of the IOC */
+extern "C" int ADAravisDiscovery(double period)
+{
+    arvDiscovery::instance()->setPeriod(period);
+    return(asynSuccess);
+}
+
+static const iocshArg ADAravisDiscoveryArg0 = {"Refresh period", iocshArgDouble};
+static const iocshArg * const ADAravisDiscoveryArgs[] = {&ADAravisDiscoveryArg0};
+static const iocshFuncDef discoveryADAravis = {"aravisDiscovery", 1, ADAravisDiscoveryArgs};
+static void discoveryADAravisCallFunc(const iocshArgBuf *args)
+{
+    ADAravisDiscovery(args[0].dval);
+}
+
+
+/** Collect the feature writes done by autosave and PINI while the IOC starts, for the cameras configured after this,
+    and apply them in one pass after iocInit. 0 writes each feature as it is restored */
+extern "C" int ADAravisBulkRestore(int enable)
+{
+    bulkRestore = enable;
+    return(asynSuccess);
+}
+
+static const iocshArg ADAravisBulkRestoreArg0 = {"Enable", iocshArgInt};
+static const iocshArg * const ADAravisBulkRestoreArgs[] = {&ADAravisBulkRestoreArg0};
+static const iocshFuncDef bulkRestoreADAravis = {"aravisBulkRestore", 1, ADAravisBulkRestoreArgs};
+static void bulkRestoreADAravisCallFunc(const iocshArgBuf *args)
+{
+    ADAravisBulkRestore(args[0].ival);
+}
+
+/** Connect the cameras configured after this in parallel threads, with iocInit waiting up to timeout seconds
+    for them. 0 connects each camera in aravisConfig */
+extern "C" int ADAravisParallelInit(double timeout)
+{
+    if (parallelInitLock == NULL) parallelInitLock = epicsMutexMustCreate();
+    parallelInitTimeout = timeout;
+    return(asynSuccess);
+}
+
+static const iocshArg ADAravisParallelInitArg0 = {"Timeout", iocshArgDouble};
+static const iocshArg * const ADAravisParallelInitArgs[] = {&ADAravisParallelInitArg0};
+static const iocshFuncDef parallelInitADAravis = {"aravisParallelInit", 1, ADAravisParallelInitArgs};
+static void parallelInitADAravisCallFunc(const iocshArgBuf *args)
+{
+    ADAravisParallelInit(args[0].dval);
 }
 
 
@@ -1036,6 +4317,9 @@ static void ADAravisRegister(void)
 {
 
     iocshRegister(&configADAravis, configADAravisCallFunc);
+    iocshRegister(&discoveryADAravis, discoveryADAravisCallFunc);
+    iocshRegister(&parallelInitADAravis, parallelInitADAravisCallFunc);
+    iocshRegister(&bulkRestoreADAravis, bulkRestoreADAravisCallFunc);
 }
 
 extern "C" {
@@ -0,0 +1,97 @@
+// arvArrayPool.cpp
+// NDArrayPool that locks the frame memory of ADAravis, and unlocks it when it is freed
+
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include <arvArrayPool.h>
+
+/* From numaif.h, so that libnuma is not needed */
+#ifndef MPOL_BIND
+#define MPOL_BIND 2
+#endif
+#ifndef MPOL_MF_MOVE
+#define MPOL_MF_MOVE (1<<1)
+#endif
+#define HUGE_PAGE_SIZE (2*1024*1024)
+
+arvArrayPool::arvArrayPool(asynNDArrayDriver *pDriver, size_t maxMemory)
+    : NDArrayPool(pDriver, maxMemory), locked(0)
+{
+}
+
+/** Prepare the memory of a frame buffer if it has not been already: ask for transparent huge pages for the
+  * 2 MB aligned part of it, bind it to a NUMA node, and lock it into memory, which also faults in all the pages
+  * now rather than on the first frame. If it cannot be locked the pages are just touched */
+void arvArrayPool::prepare(void *pData, size_t size, bool hugePages, int numaNode)
+{
+    size_t pageSize = sysconf(_SC_PAGESIZE);
+    uintptr_t start = (uintptr_t) pData;
+    uintptr_t end = start + size;
+    struct region r = {size, NULL, 0};
+
+    this->mutex.lock();
+    std::map<void*, struct region>::iterator it = this->prepared.find(pData);
+    if ((it != this->prepared.end()) && (it->second.size >= size)) {
+        this->mutex.unlock();
+        return;
+    }
+    /* The array was given more memory at the same address */
+    if ((it != this->prepared.end()) && it->second.locked) {
+        munlock(it->second.pLocked, it->second.locked);
+        this->locked -= it->second.locked;
+    }
+    if (hugePages) {
+        uintptr_t hugeStart = (start + HUGE_PAGE_SIZE - 1) & ~((uintptr_t) HUGE_PAGE_SIZE - 1);
+        uintptr_t hugeEnd = end & ~((uintptr_t) HUGE_PAGE_SIZE - 1);
+        if (hugeEnd > hugeStart) madvise((void *) hugeStart, hugeEnd - hugeStart, MADV_HUGEPAGE);
+    }
+    /* Only whole pages, the partial ones at the ends may belong to other allocations */
+    uintptr_t pageStart = (start + pageSize - 1) & ~((uintptr_t) pageSize - 1);
+    uintptr_t pageEnd = end & ~((uintptr_t) pageSize - 1);
+    if (pageEnd > pageStart) {
+        if ((numaNode >= 0) && (numaNode < (int) (8 * sizeof(unsigned long)))) {
+            unsigned long nodeMask = 1UL << numaNode;
+            syscall(SYS_mbind, pageStart, pageEnd - pageStart, MPOL_BIND, &nodeMask, 8 * sizeof(nodeMask),
+                    MPOL_MF_MOVE);
+        }
+        if (mlock((void *) pageStart, pageEnd - pageStart) == 0) {
+            r.pLocked = (void *) pageStart;
+            r.locked = pageEnd - pageStart;
+            this->locked += r.locked;
+        } else {
+            for (uintptr_t p = pageStart; p < pageEnd; p += pageSize) {
+                *(volatile char *) p = 0;
+            }
+        }
+    }
+    this->prepared[pData] = r;
+    this->mutex.unlock();
+}
+
+/** Bytes of memory locked */
+size_t arvArrayPool::getLocked()
+{
+    this->mutex.lock();
+    size_t n = this->locked;
+    this->mutex.unlock();
+    return n;
+}
+
+/** Unlock the memory before the pool frees it, and forget it so it is prepared again if the address is reused */
+void arvArrayPool::memoryFree(void *ptr, size_t size)
+{
+    this->mutex.lock();
+    std::map<void*, struct region>::iterator it = this->prepared.find(ptr);
+    if (it != this->prepared.end()) {
+        if (it->second.locked) {
+            munlock(it->second.pLocked, it->second.locked);
+            this->locked -= it->second.locked;
+        }
+        this->prepared.erase(it);
+    }
+    this->mutex.unlock();
+    NDArrayPool::memoryFree(ptr, size);
+}
@@ -0,0 +1,34 @@
+#ifndef ARV_ARRAY_POOL_H
+#define ARV_ARRAY_POOL_H
+
+#include <map>
+
+#include <epicsMutex.h>
+
+#include <NDArray.h>
+
+/** NDArrayPool that can lock the memory of its arrays, ask for transparent huge pages and bind it to a NUMA node.
+  * The memory is prepared when the driver first uses an array as a frame buffer, and is unlocked when the pool
+  * frees it, so memory that is freed and allocated again at the same address is prepared again */
+class arvArrayPool : public NDArrayPool {
+public:
+    arvArrayPool(asynNDArrayDriver *pDriver, size_t maxMemory);
+    void prepare(void *pData, size_t size, bool hugePages, int numaNode);
+    size_t getLocked();
+
+protected:
+    virtual void memoryFree(void *ptr, size_t size);
+
+private:
+    struct region {
+        size_t size;
+        void *pLocked;
+        size_t locked;
+    };
+    epicsMutex mutex;
+    /* The memory prepared, by its address. Removed when the pool frees it */
+    std::map<void*, struct region> prepared;
+    size_t locked;
+};
+
+#endif
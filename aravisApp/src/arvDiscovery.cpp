@@ -0,0 +1,191 @@
+// arvDiscovery.cpp
+// Camera list shared by all the ADAravis instances, so connecting does not enumerate every interface
+
+#include <arpa/inet.h>
+#include <string.h>
+
+#include <arvDiscovery.h>
+
+/* Default seconds between background refreshes of the camera list */
+#define DEFAULT_PERIOD 60.
+/* A camera that is not in the list only refreshes it if the list is older than this */
+#define MIN_REFRESH_AGE 2.
+
+static const char *safeString(const char *s) {
+    return s ? s : "";
+}
+
+/* Called once, as the cameras can connect in parallel */
+void arvDiscovery::makeInstance(void *arg)
+{
+    *(arvDiscovery **) arg = new arvDiscovery();
+}
+
+arvDiscovery::arvDiscovery()
+    : thread(*this, "aravisDiscovery", epicsThreadGetStackSize(epicsThreadStackMedium), epicsThreadPriorityLow),
+    period(DEFAULT_PERIOD), started(false), refreshed(false), opening(0), refreshTime(0), refreshes(0), lookups(0),
+    misses(0)
+{
+    this->wakeEvent = epicsEventMustCreate(epicsEventEmpty);
+    epicsTimeGetCurrent(&this->lastRefresh);
+}
+
+/** The list of the IOC, made the first time it is used */
+arvDiscovery *arvDiscovery::instance()
+{
+    static epicsThreadOnceId onceId = EPICS_THREAD_ONCE_INIT;
+    static arvDiscovery *pDiscovery = NULL;
+    epicsThreadOnce(&onceId, makeInstance, &pDiscovery);
+    return pDiscovery;
+}
+
+/** Update the list from aravis. Mutex taken, it is released while waiting for the devices being opened */
+void arvDiscovery::refresh()
+{
+    epicsTimeStamp start;
+
+    /* The devices are opened from the aravis lists without the mutex, so they can download their XML in parallel */
+    while (this->opening > 0) {
+        this->mutex.unlock();
+        epicsThreadSleep(0.05);
+        this->mutex.lock();
+    }
+    epicsTimeGetCurrent(&start);
+    arv_update_device_list();
+    unsigned int n = arv_get_n_devices();
+    this->devices.resize(n);
+    for (unsigned int i = 0; i < n; i++) {
+        struct device_entry *pEntry = &this->devices[i];
+        pEntry->id         = safeString(arv_get_device_id(i));
+        pEntry->physicalId = safeString(arv_get_device_physical_id(i));
+        pEntry->address    = safeString(arv_get_device_address(i));
+        pEntry->protocol   = safeString(arv_get_device_protocol(i));
+        pEntry->serial     = safeString(arv_get_device_serial_nbr(i));
+    }
+    epicsTimeGetCurrent(&this->lastRefresh);
+    this->refreshTime = epicsTimeDiffInSeconds(&this->lastRefresh, &start);
+    this->refreshed = true;
+    this->refreshes++;
+}
+
+/** The camera called cameraName, which can be its id, physical id, address or serial number. Mutex taken */
+const struct arvDiscovery::device_entry *arvDiscovery::find(const char *cameraName)
+{
+    for (size_t i = 0; i < this->devices.size(); i++) {
+        const struct device_entry *pEntry = &this->devices[i];
+        if ((pEntry->id == cameraName) || (pEntry->physicalId == cameraName) ||
+            (pEntry->address == cameraName) || (pEntry->serial == cameraName)) {
+            return pEntry;
+        }
+    }
+    return NULL;
+}
+
+/** Open the camera called cameraName, or the first camera if it is NULL or empty. Returns NULL with error set on failure */
+ArvDevice *arvDiscovery::openDevice(const char *cameraName, GError **error)
+{
+    ArvInterface *pInterface = NULL;
+    std::string deviceId;
+    struct in_addr address;
+    ArvDevice *device;
+    epicsTimeStamp now;
+
+    if ((cameraName != NULL) && (cameraName[0] == 0)) cameraName = NULL;
+    this->mutex.lock();
+    if (!this->started) {
+        this->started = true;
+        this->thread.start();
+    }
+    this->lookups++;
+    if (!this->refreshed) this->refresh();
+    const struct device_entry *pEntry = (cameraName == NULL) ?
+        (this->devices.empty() ? NULL : &this->devices[0]) : this->find(cameraName);
+    bool isAddress = (cameraName != NULL) && (inet_pton(AF_INET, cameraName, &address) == 1);
+    epicsTimeGetCurrent(&now);
+    if ((pEntry == NULL) && !isAddress && (epicsTimeDiffInSeconds(&now, &this->lastRefresh) > MIN_REFRESH_AGE)) {
+        /* A camera that was just plugged in or powered up */
+        this->misses++;
+        this->refresh();
+        pEntry = (cameraName == NULL) ?
+            (this->devices.empty() ? NULL : &this->devices[0]) : this->find(cameraName);
+    }
+    if (pEntry != NULL) {
+        deviceId = pEntry->id;
+        if (pEntry->protocol == "GigEVision") {
+            pInterface = arv_gv_interface_get_instance();
+        } else if (pEntry->protocol == "USB3Vision") {
+            pInterface = arv_uv_interface_get_instance();
+        }
+    } else if (isAddress) {
+        /* The GigE interface finds a camera by its address without a broadcast to every network */
+        deviceId = cameraName;
+        pInterface = arv_gv_interface_get_instance();
+    } else {
+        this->mutex.unlock();
+        g_set_error(error, ARV_DEVICE_ERROR, ARV_DEVICE_ERROR_NOT_FOUND,
+                    "Camera '%s' not found", cameraName ? cameraName : "");
+        return NULL;
+    }
+    this->opening++;
+    this->mutex.unlock();
+    if (pInterface != NULL) {
+        device = arv_interface_open_device(pInterface, deviceId.c_str(), error);
+    } else {
+        /* An interface without its own lookup, the fake camera for example */
+        device = arv_open_device(deviceId.c_str(), error);
+    }
+    this->mutex.lock();
+    this->opening--;
+    this->mutex.unlock();
+    return device;
+}
+
+/** Set the seconds between background refreshes, 0 to only refresh when a camera is not found */
+void arvDiscovery::setPeriod(double period)
+{
+    this->mutex.lock();
+    this->period = period;
+    if (!this->started) {
+        this->started = true;
+        this->thread.start();
+    }
+    this->mutex.unlock();
+    epicsEventSignal(this->wakeEvent);
+}
+
+void arvDiscovery::report(FILE *fp)
+{
+    char timeString[64];
+
+    this->mutex.lock();
+    epicsTimeToStrftime(timeString, sizeof(timeString), "%Y/%m/%d %H:%M:%S", &this->lastRefresh);
+    fprintf(fp, "  Camera list:       %d cameras at %s, took %.3f s, refresh every %.1f s\n",
+            (int)this->devices.size(), this->refreshed ? timeString : "never", this->refreshTime, this->period);
+    fprintf(fp, "                     %d refreshes, %d lookups, %d not in the list\n",
+            this->refreshes, this->lookups, this->misses);
+    for (size_t i = 0; i < this->devices.size(); i++) {
+        const struct device_entry *pEntry = &this->devices[i];
+        fprintf(fp, "    %s: %s, %s, %s\n", pEntry->protocol.c_str(), pEntry->id.c_str(),
+                pEntry->physicalId.c_str(), pEntry->address.c_str());
+    }
+    this->mutex.unlock();
+}
+
+/** Refreshes the list in the background */
+void arvDiscovery::run()
+{
+    while (true) {
+        this->mutex.lock();
+        double period = this->period;
+        this->mutex.unlock();
+        if (period > 0) {
+            if (epicsEventWaitWithTimeout(this->wakeEvent, period) == epicsEventWaitOK) continue;
+        } else {
+            epicsEventWait(this->wakeEvent);
+            continue;
+        }
+        this->mutex.lock();
+        this->refresh();
+        this->mutex.unlock();
+    }
+}
@@ -0,0 +1,64 @@
+#ifndef ARV_DISCOVERY_H
+#define ARV_DISCOVERY_H
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include <epicsEvent.h>
+#include <epicsMutex.h>
+#include <epicsThread.h>
+#include <epicsTime.h>
+
+/* aravis includes */
+extern "C" {
+    #include <arv.h>
+}
+
+/** The list of the cameras aravis can see, shared by all the ADAravis instances in the IOC.
+  * Opening a camera by name makes aravis enumerate every interface, which takes seconds. Here the list
+  * is refreshed by a background thread instead, so connecting only looks the name up in it and opens
+  * the device on its own interface. A GigE camera given by IP address is opened directly even when it
+  * is not in the list. The aravis device lists are not thread safe, so they are only used through this class,
+  * which does not refresh them while a device is being opened. */
+class arvDiscovery : public epicsThreadRunable {
+public:
+    static arvDiscovery *instance();
+    ArvDevice *openDevice(const char *cameraName, GError **error);
+    void setPeriod(double period);
+    void report(FILE *fp);
+
+    /* This is the method we override from epicsThreadRunable */
+    void run();
+
+private:
+    struct device_entry {
+        std::string id;
+        std::string physicalId;
+        std::string address;
+        std::string protocol;
+        std::string serial;
+    };
+    arvDiscovery();
+    static void makeInstance(void *arg);
+    void refresh();
+    const struct device_entry *find(const char *cameraName);
+
+    epicsMutex mutex;
+    epicsThread thread;
+    epicsEventId wakeEvent;
+    std::vector<struct device_entry> devices;
+    /* Seconds between background refreshes, 0 to only refresh when a camera is not found */
+    double period;
+    bool started;
+    bool refreshed;
+    /* Devices being opened, the list is not refreshed until they are done */
+    int opening;
+    epicsTimeStamp lastRefresh;
+    double refreshTime;
+    int refreshes;
+    int lookups;
+    int misses;
+};
+
+#endif
@@ -0,0 +1,71 @@
+// arvRawDump.cpp
+// Lists the frames of a raw capture written by the ADAravis recorder and extracts them to files
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include <arvRawFile.h>
+
+static void usage()
+{
+    printf("Usage: arvRawDump <name> [first last outputPrefix]\n"
+           "  <name> is the capture without the %s/%s extension.\n"
+           "  Without more arguments the index is listed. Otherwise frames first to last are\n"
+           "  written to outputPrefix_<n>.raw exactly as the camera sent them.\n",
+           ARV_RAW_DATA_EXT, ARV_RAW_INDEX_EXT);
+}
+
+int main(int argc, char *argv[])
+{
+    arvRawReader reader;
+
+    if ((argc != 2) && (argc != 5)) {
+        usage();
+        return 1;
+    }
+    if (!reader.open(argv[1])) {
+        fprintf(stderr, "arvRawDump: %s\n", reader.errorMessage());
+        return 1;
+    }
+    size_t numFrames = reader.numFrames();
+
+    if (argc == 2) {
+        printf("%lu frames\n", (unsigned long) numFrames);
+        printf("%8s %6s %12s %12s %20s %20s %10s %6s %6s %6s %6s %6s\n", "frame", "stream", "offset", "size",
+               "timestamp", "systemTimestamp", "format", "width", "height", "x", "y", "status");
+        for (size_t i=0; i<numFrames; i++) {
+            const arvRawEntry &e = reader.entry(i);
+            printf("%8llu %6u %12llu %12llu %20llu %20llu 0x%08x %6u %6u %6u %6u %6d\n",
+                   (unsigned long long) e.frameId, e.stream, (unsigned long long) e.offset,
+                   (unsigned long long) e.size, (unsigned long long) e.timestamp,
+                   (unsigned long long) e.systemTimestamp, e.pixelFormat, e.width, e.height,
+                   e.xOffset, e.yOffset, (int) e.status);
+        }
+        return 0;
+    }
+
+    size_t first = strtoul(argv[2], NULL, 0);
+    size_t last = strtoul(argv[3], NULL, 0);
+    if (last >= numFrames) last = numFrames - 1;
+    std::vector<char> data;
+    char fileName[1024];
+    for (size_t i=first; (i<=last) && (i<numFrames); i++) {
+        const arvRawEntry &e = reader.entry(i);
+        data.resize(e.size);
+        if (!reader.readFrame(i, &data[0])) {
+            fprintf(stderr, "arvRawDump: frame %lu: %s\n", (unsigned long) i, reader.errorMessage());
+            return 1;
+        }
+        snprintf(fileName, sizeof(fileName), "%s_%lu.raw", argv[4], (unsigned long) i);
+        FILE *fp = fopen(fileName, "wb");
+        if (!fp || (fwrite(&data[0], 1, data.size(), fp) != data.size())) {
+            perror(fileName);
+            if (fp) fclose(fp);
+            return 1;
+        }
+        fclose(fp);
+    }
+    return 0;
+}
@@ -0,0 +1,99 @@
+// arvRawFile.cpp
+// Reader for the raw captures written by arvRecorder
+
+#include <errno.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include <arvRawFile.h>
+
+arvRawReader::arvRawReader()
+    : dataFile(NULL)
+{
+}
+
+arvRawReader::~arvRawReader()
+{
+    this->close();
+}
+
+/** Open <baseName>.arvraw and read all of <baseName>.arvidx */
+bool arvRawReader::open(const char *baseName)
+{
+    std::string name = baseName;
+    struct arvRawHeader header;
+    struct arvRawEntry entry;
+
+    this->close();
+    FILE *indexFile = fopen((name + ARV_RAW_INDEX_EXT).c_str(), "rb");
+    if (!indexFile) {
+        message = name + ARV_RAW_INDEX_EXT + ": " + strerror(errno);
+        return false;
+    }
+    if ((fread(&header, sizeof(header), 1, indexFile) != 1) ||
+        (memcmp(header.magic, ARV_RAW_MAGIC, sizeof(header.magic)) != 0)) {
+        message = name + ARV_RAW_INDEX_EXT + ": not a raw capture index";
+        fclose(indexFile);
+        return false;
+    }
+    if (!(((header.version == ARV_RAW_VERSION) && (header.entrySize == sizeof(entry))) ||
+          ((header.version == 1) && (header.entrySize == ARV_RAW_ENTRY_SIZE_V1)))) {
+        message = name + ARV_RAW_INDEX_EXT + ": unsupported version";
+        fclose(indexFile);
+        return false;
+    }
+    /* A capture that was not closed cleanly can end with part of an entry, which is ignored.
+     * The fields an older version does not have are 0, which is ARV_BUFFER_STATUS_SUCCESS */
+    memset(&entry, 0, sizeof(entry));
+    while (fread(&entry, header.entrySize, 1, indexFile) == 1) {
+        entries.push_back(entry);
+    }
+    fclose(indexFile);
+
+    dataFile = fopen((name + ARV_RAW_DATA_EXT).c_str(), "rb");
+    if (!dataFile) {
+        message = name + ARV_RAW_DATA_EXT + ": " + strerror(errno);
+        entries.clear();
+        return false;
+    }
+    message.clear();
+    return true;
+}
+
+void arvRawReader::close()
+{
+    if (dataFile) fclose(dataFile);
+    dataFile = NULL;
+    entries.clear();
+}
+
+size_t arvRawReader::numFrames() const
+{
+    return entries.size();
+}
+
+const arvRawEntry &arvRawReader::entry(size_t n) const
+{
+    return entries[n];
+}
+
+/** Read frame n into pData, which must hold entry(n).size bytes */
+bool arvRawReader::readFrame(size_t n, void *pData)
+{
+    if (!dataFile || (n >= entries.size())) {
+        message = "no such frame";
+        return false;
+    }
+    const arvRawEntry &e = entries[n];
+    if ((fseeko(dataFile, (off_t) e.offset, SEEK_SET) != 0) ||
+        (fread(pData, 1, e.size, dataFile) != e.size)) {
+        message = "frame is past the end of the data file";
+        return false;
+    }
+    return true;
+}
+
+const char *arvRawReader::errorMessage() const
+{
+    return message.c_str();
+}
@@ -0,0 +1,63 @@
+#ifndef ARV_RAW_FILE_H
+#define ARV_RAW_FILE_H
+
+/* The raw capture written by the ADAravis recorder.
+ *
+ * <name>.arvraw holds the frames exactly as the camera sent them, one after the other.
+ * <name>.arvidx holds an arvRawHeader followed by one arvRawEntry per frame, giving where the
+ * frame is in the data file and what is needed to decode it. Both are in host byte order. */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#define ARV_RAW_MAGIC       "ARVRAWIX"
+#define ARV_RAW_VERSION     2
+#define ARV_RAW_DATA_EXT    ".arvraw"
+#define ARV_RAW_INDEX_EXT   ".arvidx"
+
+struct arvRawHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t entrySize;
+};
+
+struct arvRawEntry {
+    uint64_t offset;            /* Position of the frame in the data file */
+    uint64_t size;              /* Bytes in the frame */
+    uint64_t frameId;           /* arv_buffer_get_frame_id */
+    uint64_t timestamp;         /* arv_buffer_get_timestamp, camera clock in ns */
+    uint64_t systemTimestamp;   /* arv_buffer_get_system_timestamp, host clock in ns */
+    uint32_t pixelFormat;       /* ArvPixelFormat */
+    uint32_t width;
+    uint32_t height;
+    uint32_t xOffset;
+    uint32_t yOffset;
+    uint32_t stream;            /* Stream the frame came from, which is also its NDArray address */
+    uint32_t status;            /* ArvBufferStatus, added in version 2. Version 1 only had successful frames */
+    uint32_t reserved;
+};
+
+/* Version 1 entries end before status */
+#define ARV_RAW_ENTRY_SIZE_V1   64
+
+/** Reads a capture written by the recorder, so it can be converted into NDArrays or replayed */
+class arvRawReader {
+public:
+    arvRawReader();
+    ~arvRawReader();
+    bool open(const char *baseName);
+    void close();
+    size_t numFrames() const;
+    const arvRawEntry &entry(size_t n) const;
+    bool readFrame(size_t n, void *pData);
+    const char *errorMessage() const;
+
+private:
+    FILE *dataFile;
+    std::vector<arvRawEntry> entries;
+    std::string message;
+};
+
+#endif
@@ -0,0 +1,273 @@
+// arvRecorder.cpp
+// Raw-to-disk recording of the ADAravis stream buffers
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <arvRecorder.h>
+
+/* Size of each write, large enough for the disk to stream at full speed */
+#define CHUNK_SIZE (8 * 1024 * 1024)
+/* O_DIRECT needs the memory, the file position and the length aligned to the logical block size */
+#define DIRECT_ALIGN 4096
+/* Most chunks that can be waiting to be written */
+#define MAX_CHUNKS 4096
+
+arvRecorder::arvRecorder()
+    : thread(*this, "aravisRecord", epicsThreadGetStackSize(epicsThreadStackMedium), epicsThreadPriorityMedium),
+    isOpen(false), direct(false), fd(-1), indexFile(NULL), current(-1), fill(0), length(0),
+    frames(0), dropped(0), bytesWritten(0), writeErrno(0)
+{
+    this->doneEvent = epicsEventMustCreate(epicsEventEmpty);
+    this->freeQId = epicsMessageQueueCreate(MAX_CHUNKS, sizeof(int));
+    this->fullQId = epicsMessageQueueCreate(MAX_CHUNKS + 1, sizeof(struct chunk_msg));
+    this->thread.start();
+}
+
+/** Create <baseName>.arvraw and <baseName>.arvidx, with bufferSize bytes of chunks to absorb the
+    difference between the frame rate and the disk. Returns false with message set on error */
+bool arvRecorder::open(const char *baseName, size_t bufferSize, std::string &message)
+{
+    std::string name = baseName;
+    std::string dataName = name + ARV_RAW_DATA_EXT;
+    std::string indexName = name + ARV_RAW_INDEX_EXT;
+    struct arvRawHeader header;
+
+    this->close();
+    this->mutex.lock();
+    /* Not every file system allows O_DIRECT, those get ordinary writes */
+    this->direct = true;
+    this->fd = ::open(dataName.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+    if (this->fd < 0) {
+        this->direct = false;
+        this->fd = ::open(dataName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    }
+    if (this->fd < 0) {
+        message = dataName + ": " + strerror(errno);
+        this->mutex.unlock();
+        return false;
+    }
+    this->indexFile = fopen(indexName.c_str(), "wb");
+    if (!this->indexFile) {
+        message = indexName + ": " + strerror(errno);
+        ::close(this->fd);
+        this->fd = -1;
+        this->mutex.unlock();
+        return false;
+    }
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, ARV_RAW_MAGIC, sizeof(header.magic));
+    header.version = ARV_RAW_VERSION;
+    header.entrySize = sizeof(struct arvRawEntry);
+    fwrite(&header, sizeof(header), 1, this->indexFile);
+
+    size_t numChunks = bufferSize / CHUNK_SIZE;
+    if (numChunks < 2) numChunks = 2;
+    if (numChunks > MAX_CHUNKS) numChunks = MAX_CHUNKS;
+    for (size_t i=0; i<numChunks; i++) {
+        void *pChunk;
+        if (posix_memalign(&pChunk, DIRECT_ALIGN, CHUNK_SIZE) != 0) break;
+        int index = (int) this->chunks.size();
+        this->chunks.push_back((char *) pChunk);
+        epicsMessageQueueSend(this->freeQId, &index, sizeof(index));
+    }
+    if (this->chunks.size() < 2) {
+        message = "cannot allocate the recording buffer";
+        this->freeChunks();
+        fclose(this->indexFile);
+        this->indexFile = NULL;
+        ::close(this->fd);
+        this->fd = -1;
+        this->mutex.unlock();
+        return false;
+    }
+    this->current = -1;
+    this->fill = 0;
+    this->length = 0;
+    this->frames = 0;
+    this->dropped = 0;
+    this->bytesWritten = 0;
+    this->writeErrno = 0;
+    this->isOpen = true;
+    this->mutex.unlock();
+    return true;
+}
+
+/** Write what is still buffered and close the files. Frames added after this are ignored */
+void arvRecorder::close()
+{
+    struct chunk_msg msg;
+
+    this->mutex.lock();
+    if (!this->isOpen) {
+        this->mutex.unlock();
+        return;
+    }
+    this->isOpen = false;
+    if (this->current >= 0) {
+        msg.index = this->current;
+        msg.length = this->fill;
+        epicsMessageQueueSend(this->fullQId, &msg, sizeof(msg));
+        this->current = -1;
+        this->fill = 0;
+    }
+    msg.index = -1;
+    msg.length = 0;
+    epicsMessageQueueSend(this->fullQId, &msg, sizeof(msg));
+    this->mutex.unlock();
+
+    /* Once the writer has seen the marker it has written everything before it */
+    epicsEventMustWait(this->doneEvent);
+
+    this->mutex.lock();
+    /* Remove the padding of the last O_DIRECT write */
+    if (ftruncate(this->fd, (off_t) this->length) != 0 && !this->writeErrno) this->writeErrno = errno;
+    ::close(this->fd);
+    this->fd = -1;
+    fclose(this->indexFile);
+    this->indexFile = NULL;
+    this->freeChunks();
+    this->mutex.unlock();
+}
+
+/** Copy a frame into the chunks and add it to the index. Returns false if it was dropped */
+bool arvRecorder::addFrame(ArvBuffer *buffer, int stream)
+{
+    size_t size;
+    struct chunk_msg msg;
+    struct arvRawEntry entry;
+
+    const char *pData = (const char *) arv_buffer_get_data(buffer, &size);
+    if (!pData || (size == 0)) return false;
+
+    this->mutex.lock();
+    if (!this->isOpen) {
+        this->mutex.unlock();
+        return false;
+    }
+    /* Only the writer thread adds to the free chunks, so if enough are free now they stay free.
+     * fill is 0 when there is no current chunk */
+    size_t needed = (this->fill + size + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    if (this->current >= 0) needed--;
+    if ((size_t) epicsMessageQueuePending(this->freeQId) < needed) {
+        this->dropped++;
+        this->mutex.unlock();
+        return false;
+    }
+
+    memset(&entry, 0, sizeof(entry));
+    entry.offset          = this->length;
+    entry.size            = size;
+    entry.frameId         = arv_buffer_get_frame_id(buffer);
+    entry.timestamp       = arv_buffer_get_timestamp(buffer);
+    entry.systemTimestamp = arv_buffer_get_system_timestamp(buffer);
+    entry.pixelFormat     = arv_buffer_get_image_pixel_format(buffer);
+    entry.width           = arv_buffer_get_image_width(buffer);
+    entry.height          = arv_buffer_get_image_height(buffer);
+    entry.xOffset         = arv_buffer_get_image_x(buffer);
+    entry.yOffset         = arv_buffer_get_image_y(buffer);
+    entry.stream          = stream;
+    entry.status          = arv_buffer_get_status(buffer);
+
+    while (size > 0) {
+        if (this->current < 0) {
+            epicsMessageQueueTryReceive(this->freeQId, &this->current, sizeof(this->current));
+            this->fill = 0;
+        }
+        size_t n = CHUNK_SIZE - this->fill;
+        if (n > size) n = size;
+        memcpy(this->chunks[this->current] + this->fill, pData, n);
+        this->fill   += n;
+        this->length += n;
+        pData += n;
+        size  -= n;
+        if (this->fill == CHUNK_SIZE) {
+            msg.index = this->current;
+            msg.length = CHUNK_SIZE;
+            epicsMessageQueueSend(this->fullQId, &msg, sizeof(msg));
+            this->current = -1;
+            this->fill = 0;
+        }
+    }
+    fwrite(&entry, sizeof(entry), 1, this->indexFile);
+    this->frames++;
+    this->mutex.unlock();
+    return true;
+}
+
+void arvRecorder::getStatistics(int *frames, int *dropped, double *bytesWritten, bool *direct, int *writeErrno)
+{
+    this->mutex.lock();
+    *frames = this->frames;
+    *dropped = this->dropped;
+    *direct = this->direct;
+    this->mutex.unlock();
+    *bytesWritten = this->bytesWritten;
+    *writeErrno = this->writeErrno;
+}
+
+void arvRecorder::freeChunks()
+{
+    int index;
+
+    while (epicsMessageQueueTryReceive(this->freeQId, &index, sizeof(index)) != -1);
+    for (size_t i=0; i<this->chunks.size(); i++) {
+        free(this->chunks[i]);
+    }
+    this->chunks.clear();
+}
+
+/** The writer thread. Writes the full chunks in order and hands them back */
+void arvRecorder::run()
+{
+    struct chunk_msg msg;
+
+    while (1) {
+        epicsMessageQueueReceive(this->fullQId, &msg, sizeof(msg));
+        if (msg.index < 0) {
+            epicsEventSignal(this->doneEvent);
+            continue;
+        }
+        /* The file and the chunks stay until close() has seen the marker, so they are used without the lock */
+        this->mutex.lock();
+        char *pChunk = this->chunks[msg.index];
+        bool direct = this->direct;
+        int fd = this->fd;
+        this->mutex.unlock();
+        size_t len = msg.length;
+        /* Only the last chunk can be partly filled. O_DIRECT writes it in whole blocks */
+        if (direct && (len % DIRECT_ALIGN)) {
+            size_t padded = (len + DIRECT_ALIGN - 1) / DIRECT_ALIGN * DIRECT_ALIGN;
+            memset(pChunk + len, 0, padded - len);
+            len = padded;
+        }
+        /* After an error the remaining chunks are discarded, the error is reported by getStatistics */
+        while ((len > 0) && !this->writeErrno) {
+            ssize_t n = write(fd, pChunk, len);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                this->writeErrno = errno;
+                break;
+            }
+            pChunk += n;
+            len    -= n;
+            this->bytesWritten += n;
+            /* A short O_DIRECT write leaves the next one unaligned, so carry on with ordinary writes */
+            if (direct && (len > 0)) {
+                int flags = fcntl(fd, F_GETFL);
+                if ((flags == -1) || (fcntl(fd, F_SETFL, flags & ~O_DIRECT) == -1)) {
+                    this->writeErrno = errno;
+                    break;
+                }
+                direct = false;
+                this->mutex.lock();
+                this->direct = false;
+                this->mutex.unlock();
+            }
+        }
+        epicsMessageQueueSend(this->freeQId, &msg.index, sizeof(msg.index));
+    }
+}
@@ -0,0 +1,64 @@
+#ifndef ARV_RECORDER_H
+#define ARV_RECORDER_H
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include <epicsEvent.h>
+#include <epicsMessageQueue.h>
+#include <epicsMutex.h>
+#include <epicsThread.h>
+
+#include <arvRawFile.h>
+
+/* aravis includes */
+extern "C" {
+    #include <arv.h>
+}
+
+/** Writes the frames of an acquisition straight to disk, in the format described in arvRawFile.h.
+  * Frames are copied into large aligned chunks which a writer thread writes with O_DIRECT where the
+  * file system allows it, so the page cache and the NDArray plugins are not involved. A frame that
+  * arrives when all the chunks are waiting to be written is dropped and counted. */
+class arvRecorder : public epicsThreadRunable {
+public:
+    arvRecorder();
+    bool open(const char *baseName, size_t bufferSize, std::string &message);
+    void close();
+    bool addFrame(ArvBuffer *buffer, int stream);
+    void getStatistics(int *frames, int *dropped, double *bytesWritten, bool *direct, int *writeErrno);
+
+    /* This is the method we override from epicsThreadRunable */
+    void run();
+
+private:
+    struct chunk_msg {
+        int index;
+        size_t length;
+    };
+    void freeChunks();
+
+    epicsMutex mutex;
+    epicsThread thread;
+    epicsEventId doneEvent;
+    epicsMessageQueueId freeQId;
+    epicsMessageQueueId fullQId;
+    std::vector<char*> chunks;
+    bool isOpen;
+    bool direct;
+    int fd;
+    FILE *indexFile;
+    /* The chunk being filled and how much of it is used */
+    int current;
+    size_t fill;
+    /* Bytes of frames in the file, which O_DIRECT pads to the block size */
+    size_t length;
+    int frames;
+    int dropped;
+    /* Written by the writer thread */
+    volatile double bytesWritten;
+    volatile int writeErrno;
+};
+
+#endif
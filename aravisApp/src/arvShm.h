@@ -0,0 +1,83 @@
+#ifndef ARV_SHM_H
+#define ARV_SHM_H
+
+/* Layout of the POSIX shared-memory frame ring published by ADAravis (ARShm), for local readers.
+ * This header is plain C so that it can be used by consumers that do not use EPICS.
+ *
+ * The segment starts with an arvShmHeader, followed at ARV_SHM_SLOTS_OFFSET by numSlots arvShmSlot
+ * and at dataOffset by numSlots blocks of slotSize bytes of frame data. Frame n (counting from 1)
+ * goes in slot (n-1) % numSlots, and header.published is the number of the newest frame.
+ *
+ * There is one writer and any number of readers, which never block it. Each slot has a sequence
+ * that is odd while the driver writes the slot. A reader:
+ *   1. opens the segment with shm_open(name, O_RDONLY) and mmaps it read-only,
+ *   2. checks magic and version, and re-opens the segment if valid becomes 0,
+ *   3. reads published, then for a slot calls arvShmReadBegin, uses the metadata and frame data
+ *      in place without copying, then calls arvShmReadEnd. If that returns 0 the driver overwrote
+ *      the slot meanwhile and what was read must be discarded.
+ * Readers that fall behind by more than numSlots frames miss frames, which they can see from frameNumber. */
+
+#include <stdint.h>
+
+#define ARV_SHM_MAGIC           "ARVSHM01"
+#define ARV_SHM_VERSION         1
+#define ARV_SHM_SLOTS_OFFSET    64
+#define ARV_SHM_ALIGN           4096
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t numSlots;
+    uint64_t slotSize;          /* Bytes of frame data each slot can hold */
+    uint64_t dataOffset;        /* Offset of the data of slot 0 from the start of the segment */
+    uint32_t valid;             /* Set to 0 when the driver removes or replaces the segment */
+    uint32_t pad;
+    uint64_t published;         /* Number of the newest frame, 0 if there is none yet */
+} arvShmHeader;
+
+typedef struct {
+    uint64_t sequence;          /* Odd while the slot is being written */
+    uint64_t frameNumber;       /* Counts the frames of all the streams from 1 */
+    uint64_t frameId;           /* Frame ID from the camera */
+    uint64_t timestamp;         /* Camera clock in ns */
+    uint64_t systemTimestamp;   /* Host clock in ns when the frame arrived */
+    uint32_t epicsSec;          /* NDArray epicsTS of converted frames, otherwise 0 */
+    uint32_t epicsNsec;
+    uint64_t size;              /* Bytes of frame data */
+    uint32_t converted;         /* 1 if the data is the converted NDArray, 0 if it is as the camera sent it */
+    uint32_t pixelFormat;       /* ArvPixelFormat of the camera frame */
+    uint32_t dataType;          /* NDDataType_t of converted frames */
+    uint32_t colorMode;         /* NDColorMode_t of converted frames */
+    uint32_t width;
+    uint32_t height;
+    uint32_t xOffset;
+    uint32_t yOffset;
+    uint32_t stream;            /* Stream the frame came from, which is also its NDArray address */
+    uint32_t pad;
+} arvShmSlot;
+
+static inline arvShmSlot *arvShmGetSlot(const arvShmHeader *pHeader, uint64_t n)
+{
+    return (arvShmSlot *)((char *)pHeader + ARV_SHM_SLOTS_OFFSET) + n;
+}
+
+static inline void *arvShmGetData(const arvShmHeader *pHeader, uint64_t n)
+{
+    return (char *)pHeader + pHeader->dataOffset + n * pHeader->slotSize;
+}
+
+/* Start reading a slot. Returns 0 if it is being written, try again later */
+static inline int arvShmReadBegin(const arvShmSlot *pSlot, uint64_t *pSequence)
+{
+    *pSequence = __atomic_load_n(&pSlot->sequence, __ATOMIC_ACQUIRE);
+    return (*pSequence & 1) == 0;
+}
+
+/* Finish reading a slot. Returns 0 if it was overwritten since arvShmReadBegin */
+static inline int arvShmReadEnd(const arvShmSlot *pSlot, uint64_t sequence)
+{
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&pSlot->sequence, __ATOMIC_RELAXED) == sequence;
+}
+
+#endif
@@ -0,0 +1,138 @@
+// arvShmRing.cpp
+// Publishes frames in a POSIX shared-memory ring for readers on the same host
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include <arvShmRing.h>
+
+arvShmRing::arvShmRing()
+    : pHeader(NULL), mapSize(0), frames(0), skipped(0)
+{
+}
+
+arvShmRing::~arvShmRing()
+{
+    this->close();
+}
+
+/** Create the segment name with numSlots slots of slotSize bytes, replacing any old one.
+    Returns false with message set on error */
+bool arvShmRing::open(const char *name, int numSlots, size_t slotSize, std::string &message)
+{
+    this->close();
+    if (numSlots < 1) numSlots = 1;
+    slotSize = (slotSize + ARV_SHM_ALIGN - 1) / ARV_SHM_ALIGN * ARV_SHM_ALIGN;
+    size_t dataOffset = ARV_SHM_SLOTS_OFFSET + numSlots * sizeof(arvShmSlot);
+    dataOffset = (dataOffset + ARV_SHM_ALIGN - 1) / ARV_SHM_ALIGN * ARV_SHM_ALIGN;
+    size_t size = dataOffset + numSlots * slotSize;
+
+    /* Readers still mapping an old segment of the same name keep it until they re-open */
+    shm_unlink(name);
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0) {
+        message = std::string(name) + ": " + strerror(errno);
+        return false;
+    }
+    if (ftruncate(fd, (off_t) size) != 0) {
+        message = std::string(name) + ": " + strerror(errno);
+        ::close(fd);
+        shm_unlink(name);
+        return false;
+    }
+    void *pMap = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (pMap == MAP_FAILED) {
+        message = std::string(name) + ": " + strerror(errno);
+        shm_unlink(name);
+        return false;
+    }
+
+    this->mutex.lock();
+    /* A new segment is zero filled, so all the slots are empty */
+    arvShmHeader *pNew = (arvShmHeader *) pMap;
+    memcpy(pNew->magic, ARV_SHM_MAGIC, sizeof(pNew->magic));
+    pNew->version = ARV_SHM_VERSION;
+    pNew->numSlots = numSlots;
+    pNew->slotSize = slotSize;
+    pNew->dataOffset = dataOffset;
+    pNew->published = 0;
+    __atomic_store_n(&pNew->valid, 1, __ATOMIC_RELEASE);
+    this->name = name;
+    this->pHeader = pNew;
+    this->mapSize = size;
+    this->frames = 0;
+    this->skipped = 0;
+    this->mutex.unlock();
+    return true;
+}
+
+/** Mark the segment invalid for the readers and remove it */
+void arvShmRing::close()
+{
+    this->mutex.lock();
+    if (this->pHeader) {
+        __atomic_store_n(&this->pHeader->valid, 0, __ATOMIC_RELEASE);
+        munmap(this->pHeader, this->mapSize);
+        shm_unlink(this->name.c_str());
+        this->pHeader = NULL;
+    }
+    this->mutex.unlock();
+}
+
+/** Whether the open segment can be kept for frames of slotSize bytes, so readers do not need to re-open */
+bool arvShmRing::fits(const char *name, int numSlots, size_t slotSize)
+{
+    bool fits;
+
+    this->mutex.lock();
+    fits = this->pHeader && (this->name == name) && ((int) this->pHeader->numSlots == numSlots) &&
+           (this->pHeader->slotSize >= slotSize);
+    this->mutex.unlock();
+    return fits;
+}
+
+/** Copy a frame into the next slot with the metadata in pInfo.
+    Returns false if the ring is closed or the frame is larger than a slot */
+bool arvShmRing::publish(const void *pData, size_t size, arvShmSlot *pInfo)
+{
+    this->mutex.lock();
+    if (!this->pHeader) {
+        this->mutex.unlock();
+        return false;
+    }
+    if (size > this->pHeader->slotSize) {
+        this->skipped++;
+        this->mutex.unlock();
+        return false;
+    }
+    uint64_t frameNumber = this->pHeader->published + 1;
+    uint64_t n = (frameNumber - 1) % this->pHeader->numSlots;
+    arvShmSlot *pSlot = arvShmGetSlot(this->pHeader, n);
+
+    /* Make the slot odd before touching anything else, so readers of the old frame see the change */
+    uint64_t sequence = pSlot->sequence;
+    __atomic_store_n(&pSlot->sequence, sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(arvShmGetData(this->pHeader, n), pData, size);
+    pInfo->sequence = sequence + 1;
+    pInfo->frameNumber = frameNumber;
+    pInfo->size = size;
+    memcpy(pSlot, pInfo, sizeof(*pSlot));
+    __atomic_store_n(&pSlot->sequence, sequence + 2, __ATOMIC_RELEASE);
+    __atomic_store_n(&this->pHeader->published, frameNumber, __ATOMIC_RELEASE);
+    this->frames++;
+    this->mutex.unlock();
+    return true;
+}
+
+void arvShmRing::getStatistics(int *frames, int *skipped)
+{
+    this->mutex.lock();
+    *frames = this->frames;
+    *skipped = this->skipped;
+    this->mutex.unlock();
+}
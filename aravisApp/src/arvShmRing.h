@@ -0,0 +1,30 @@
+#ifndef ARV_SHM_RING_H
+#define ARV_SHM_RING_H
+
+#include <string>
+
+#include <epicsMutex.h>
+
+#include <arvShm.h>
+
+/** Writes frames into the shared-memory ring described in arvShm.h */
+class arvShmRing {
+public:
+    arvShmRing();
+    ~arvShmRing();
+    bool open(const char *name, int numSlots, size_t slotSize, std::string &message);
+    void close();
+    bool fits(const char *name, int numSlots, size_t slotSize);
+    bool publish(const void *pData, size_t size, arvShmSlot *pInfo);
+    void getStatistics(int *frames, int *skipped);
+
+private:
+    epicsMutex mutex;
+    std::string name;
+    arvShmHeader *pHeader;
+    size_t mapSize;
+    int frames;
+    int skipped;
+};
+
+#endif
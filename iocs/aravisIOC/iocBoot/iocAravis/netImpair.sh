@@ -0,0 +1,129 @@
+#!/bin/bash
+# Measures the GigE Vision transport of ADAravis with packet loss, reordering and delay, without a camera.
+#
+# The aravis fake GigE camera runs on the loopback interface and the IOC in st.cmd.fakeGV acquires from it.
+# For each setting the GVSP stream packets on lo are impaired with tc netem, the GVCP control and Channel
+# Access packets are not. Each setting is a netem argument list, e.g. "loss 1% delay 2ms reorder 10%",
+# taken one per line from the file given as argument, or the list below.
+# It prints the delivered frame rate, the frames completed and failed, and the missing and resent packets.
+#
+# Needs root, or CAP_NET_ADMIN, for tc, and the EPICS caget and caput tools.
+# The other settings are taken from the environment:
+#   IOC              IOC executable, default ../../bin/${EPICS_HOST_ARCH}/ADAravisApp
+#   FAKE_CAMERA      fake camera executable, default arv-fake-gv-camera-0.8
+#   PREFIX           record prefix, default 13ARVFAKE:
+#   DURATION         seconds to acquire for each setting, default 20
+#   FRAME_RATE       frame rate of the fake camera, default is its own
+#   PACKET_RESEND    ARPacketResendEnable, 0 (Never) or 1 (Always), default 1
+#   PACKET_TIMEOUT   ARPacketTimeout in us, default is the record's
+#   FRAME_RETENTION  ARFrameRetention in us, default is the record's
+
+IOC=${IOC:-../../bin/${EPICS_HOST_ARCH:-linux-x86_64}/ADAravisApp}
+FAKE_CAMERA=${FAKE_CAMERA:-arv-fake-gv-camera-0.8}
+PREFIX=${PREFIX:-13ARVFAKE:}
+DURATION=${DURATION:-20}
+PACKET_RESEND=${PACKET_RESEND:-1}
+CAM=${PREFIX}cam1:
+
+SETTINGS=(
+    "delay 0ms"
+    "loss 0.1%"
+    "loss 1%"
+    "loss 5%"
+    "delay 2ms reorder 10%"
+    "delay 2ms 1ms"
+    "loss 1% delay 2ms reorder 10%"
+)
+
+if [ $# -gt 1 ]; then
+    echo "Usage: $0 [settingsFile]"
+    exit 1
+fi
+if [ $# -eq 1 ]; then
+    SETTINGS=()
+    while read -r line; do
+        line=${line%%#*}
+        [ -n "${line// }" ] && SETTINGS+=("$line")
+    done < "$1"
+fi
+
+cd "$(dirname "$0")" || exit 1
+WORK=$(mktemp -d)
+
+cleanup() {
+    caput -t "${CAM}Acquire" 0 > /dev/null 2>&1
+    [ -n "$IOC_PID" ] && kill "$IOC_PID" 2> /dev/null
+    [ -n "$FAKE_PID" ] && kill "$FAKE_PID" 2> /dev/null
+    tc qdisc del dev lo root 2> /dev/null
+    rm -rf "$WORK"
+}
+trap cleanup EXIT
+trap 'exit 1' INT TERM
+
+# Everything on lo goes to band 1 unless it is UDP other than GVCP and Channel Access, which is the stream
+tc qdisc add dev lo root handle 1: prio bands 3 priomap 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 || exit 1
+tc qdisc add dev lo parent 1:3 handle 30: netem delay 0ms || exit 1
+for port in 3956 ${EPICS_CA_SERVER_PORT:-5064} ${EPICS_CA_REPEATER_PORT:-5065}; do
+    tc filter add dev lo parent 1: protocol ip prio 1 u32 match ip dport "$port" 0xffff flowid 1:1
+    tc filter add dev lo parent 1: protocol ip prio 1 u32 match ip sport "$port" 0xffff flowid 1:1
+done
+tc filter add dev lo parent 1: protocol ip prio 2 u32 match ip protocol 17 0xff flowid 1:3
+
+"$FAKE_CAMERA" -i lo > "$WORK/fake.log" 2>&1 &
+FAKE_PID=$!
+sleep 1
+
+# The IOC shell reads from a pipe that is never written, so it runs until it is killed
+mkfifo "$WORK/stdin"
+exec 3<> "$WORK/stdin"
+PREFIX=$PREFIX "$IOC" st.cmd.fakeGV <&3 > "$WORK/ioc.log" 2>&1 &
+IOC_PID=$!
+for i in $(seq 60); do
+    caget -w 1 "${CAM}Acquire" > /dev/null 2>&1 && break
+    if ! kill -0 "$IOC_PID" 2> /dev/null; then
+        echo "The IOC exited, its output was:"
+        cat "$WORK/ioc.log"
+        exit 1
+    fi
+done
+if ! caget -w 1 "${CAM}Acquire" > /dev/null 2>&1; then
+    echo "Cannot reach ${CAM}Acquire, the IOC output was:"
+    cat "$WORK/ioc.log"
+    exit 1
+fi
+
+caput -t "${CAM}ImageMode" 2 > /dev/null
+caput -t "${CAM}ARPacketResendEnable" "$PACKET_RESEND" > /dev/null
+[ -n "$PACKET_TIMEOUT" ] && caput -t "${CAM}ARPacketTimeout" "$PACKET_TIMEOUT" > /dev/null
+[ -n "$FRAME_RETENTION" ] && caput -t "${CAM}ARFrameRetention" "$FRAME_RETENTION" > /dev/null
+if [ -n "$FRAME_RATE" ]; then
+    caput -t "${CAM}AcquirePeriod" "$(echo "1 / $FRAME_RATE" | bc -l)" > /dev/null
+fi
+
+echo "Resend: $PACKET_RESEND, timeout: $(caget -t "${CAM}ARPacketTimeout") us," \
+     "frame retention: $(caget -t "${CAM}ARFrameRetention") us, $DURATION s per setting"
+printf "%-36s %8s %10s %10s %10s %10s\n" "setting" "fps" "completed" "failures" "missing" "resent"
+for setting in "${SETTINGS[@]}"; do
+    if ! tc qdisc change dev lo parent 1:3 handle 30: netem $setting; then
+        echo "$setting: not a netem setting"
+        continue
+    fi
+    caput -t "${CAM}Acquire" 1 > /dev/null
+    # The rate is measured once the stream is running
+    sleep 2
+    first=$(caget -t "${CAM}ArrayCounter_RBV")
+    start=$(date +%s.%N)
+    sleep "$DURATION"
+    last=$(caget -t "${CAM}ArrayCounter_RBV")
+    end=$(date +%s.%N)
+    # Wait for the status thread to publish the stream counters, they restart with the next acquisition
+    sleep 1
+    completed=$(caget -t "${CAM}ARFramesCompleted")
+    failures=$(caget -t "${CAM}ARFrameFailures")
+    missing=$(caget -t "${CAM}ARMissingPackets")
+    resent=$(caget -t "${CAM}ARResentPackets")
+    caput -t "${CAM}Acquire" 0 > /dev/null
+    fps=$(echo "($last - $first) / ($end - $start)" | bc -l)
+    printf "%-36s %8.1f %10.0f %10.0f %10d %10d\n" "$setting" "$fps" "$completed" "$failures" "$missing" "$resent"
+    sleep 1
+done